@@ -3,6 +3,21 @@ function get_setpoint(topic,data)
 %   Detailed explanation goes here
 
   assignin('base','payload',data);
-  assignin('base','position',jsondecode(data));
+  sp = jsondecode(data);
+  if numel(sp) > 1 || isfield(sp, 't')
+    % batch of future setpoints ([MQTT]:batch > 1): queue them, they are
+    % played one per sample by the mqtt_sub_position block
+    if evalin('base', 'exist(''setpoints'', ''var'')')
+      queued = evalin('base', 'setpoints');
+      sp = [queued; rmfield(sp(:), 't')];
+    else
+      sp = rmfield(sp(:), 't');
+    end
+    assignin('base','setpoints',sp);
+  else
+    % a single setpoint (e.g. a rapid) supersedes the queue
+    assignin('base','setpoints',sp([]));
+    assignin('base','position',sp);
+  end
 
 end
\ No newline at end of file
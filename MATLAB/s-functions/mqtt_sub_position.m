@@ -154,6 +154,10 @@ block.Dwork(1).Data = 0;
 %%   C MEX counterpart: mdlOutputs
 %%
 function Outputs(block)
+  % play the next batched setpoint, if any; otherwise hold the last one
+  if evalin('base', 'exist(''setpoints'', ''var'') && ~isempty(setpoints)')
+    evalin('base', 'position = setpoints(1); setpoints(1) = [];');
+  end
   block.OutputPort(1).Data = evalin('base','position.x');
   block.OutputPort(2).Data = evalin('base','position.y');
   block.OutputPort(3).Data = evalin('base','position.z');
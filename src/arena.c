@@ -0,0 +1,186 @@
+/*
+     _                                _
+    / \   _ __ ___ _ __   __ _    ___| | __ _ ___ ___
+   / _ \ | '__/ _ \ '_ \ / _` |  / __| |/ _` / __/ __|
+  / ___ \| | |  __/ | | | (_| | | (__| | (_| \__ \__ \
+ /_/   \_\_|  \___|_| |_|\__,_|  \___|_|\__,_|___/___/
+
+* This is the implementation of the Arena class of C-CNC
+*/
+#include "arena.h"
+#include <stddef.h> // max_align_t
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+#define ARENA_CHUNK (1024 * 1024)
+#define ARENA_ALIGN (_Alignof(max_align_t))
+
+// Memory chunk, the data area follows the header
+typedef struct chunk {
+  struct chunk *next; // previously filled chunk
+  size_t size;        // size of the data area
+  size_t used;        // used bytes in the data area
+  max_align_t data[]; // data area
+} chunk_t;
+
+// Structure representing the Arena class
+typedef struct arena {
+  chunk_t *head;     // chunk currently being filled
+  size_t chunk_size; // default chunk size
+  size_t size;       // total reserved memory
+} arena_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* STATIC FUNCTIONS ***********************************************************/
+static chunk_t *chunk_new(size_t size);
+
+/* LIFECYCLE ******************************************************************/
+arena_t *arena_new(size_t chunk_size) {
+  arena_t *a = malloc(sizeof(arena_t));
+  if (!a) {
+    eprintf("Error allocating memory for an arena\n");
+    return NULL;
+  }
+  memset(a, 0, sizeof(*a));
+  a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK;
+  return a;
+}
+
+void arena_free(arena_t *a) {
+  assert(a);
+  chunk_t *c = a->head, *tmp;
+  while (c) {
+    tmp = c;
+    c = c->next;
+    free(tmp);
+  }
+  free(a);
+  a = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+size_t arena_size(arena_t const *a) {
+  assert(a);
+  return a->size;
+}
+
+/* METHODS ********************************************************************/
+void *arena_alloc(arena_t *a, size_t size) {
+  assert(a);
+  void *ptr = NULL;
+  chunk_t *c = a->head;
+  // round up to keep every allocation aligned
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  if (!c || c->used + size > c->size) {
+    c = chunk_new(size > a->chunk_size ? size : a->chunk_size);
+    if (!c) {
+      eprintf("Error allocating memory for an arena chunk\n");
+      return NULL;
+    }
+    c->next = a->head;
+    a->head = c;
+    a->size += c->size;
+  }
+  ptr = (char *)c->data + c->used;
+  c->used += size;
+  return ptr;
+}
+
+char *arena_strdup(arena_t *a, char const *s) {
+  assert(a && s);
+  size_t len = strlen(s) + 1;
+  char *dup = arena_alloc(a, len);
+  if (dup)
+    memcpy(dup, s, len);
+  return dup;
+}
+
+// chunks of from go behind the head of a, which keeps being filled
+void arena_merge(arena_t *a, arena_t *from) {
+  assert(a && from);
+  chunk_t *tail = from->head;
+  if (tail) {
+    while (tail->next)
+      tail = tail->next;
+    if (a->head) {
+      tail->next = a->head->next;
+      a->head->next = from->head;
+    } else {
+      a->head = from->head;
+    }
+    a->size += from->size;
+  }
+  free(from);
+}
+
+/* STATIC FUNCTIONS ***********************************************************/
+// chunks are zeroed on allocation, so that arena_alloc() returns zeroed
+// memory
+static chunk_t *chunk_new(size_t size) {
+  chunk_t *c = calloc(1, sizeof(chunk_t) + size);
+  if (!c)
+    return NULL;
+  c->size = size;
+  return c;
+}
+
+/*
+     _                           _            _
+    / \   _ __ ___ _ __   __ _  | |_ ___  ___| |_
+   / _ \ | '__/ _ \ '_ \ / _` | | __/ _ \/ __| __|
+  / ___ \| | |  __/ | | | (_| | | ||  __/\__ \ |_
+ /_/   \_\_|  \___|_| |_|\__,_|  \__\___||___/\__|
+
+*/
+
+#ifdef ARENA_MAIN
+int main() {
+  arena_t *a = NULL, *b = NULL;
+  char *s = NULL;
+  data_t *v = NULL;
+  size_t i;
+  printf(BGRN "Arena class test executable, version %s (%s)\n" CRESET, VERSION,
+         BUILD_TYPE);
+
+  // Small chunks to exercise the chunk chaining
+  a = arena_new(64);
+  s = arena_strdup(a, "N10 G01 X100 Y100");
+  printf("Duplicated string: %s\n", s);
+  for (i = 0; i < 10; i++) {
+    v = arena_alloc(a, 3 * sizeof(data_t));
+    assert(((uintptr_t)v % _Alignof(max_align_t)) == 0);
+    assert(v[0] == 0 && v[1] == 0 && v[2] == 0);
+    v[0] = v[1] = v[2] = i;
+  }
+  // Allocations larger than the chunk size get their own chunk
+  v = arena_alloc(a, 1000 * sizeof(data_t));
+  v[999] = 1;
+  printf("Arena size: %zu bytes\n", arena_size(a));
+
+  // Merging moves the memory, which stays valid
+  b = arena_new(0);
+  s = arena_strdup(b, "N20 G00 X0 Y0");
+  arena_merge(a, b);
+  printf("Merged string: %s\n", s);
+  printf("Arena size after merge: %zu bytes\n", arena_size(a));
+
+  arena_free(a);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+     _                                _
+    / \   _ __ ___ _ __   __ _    ___| | __ _ ___ ___
+   / _ \ | '__/ _ \ '_ \ / _` |  / __| |/ _` / __/ __|
+  / ___ \| | |  __/ | | | (_| | | (__| | (_| \__ \__ \
+ /_/   \_\_|  \___|_| |_|\__,_|  \___|_|\__,_|___/___/
+
+* Program-scoped memory arena: many small objects are carved out of large
+* chunks and released all at once
+*/
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "defines.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Arena class
+typedef struct arena arena_t;
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// chunk_size is the size of each memory chunk (0 for default)
+arena_t *arena_new(size_t chunk_size);
+// Releases all the memory carved out of the arena
+void arena_free(arena_t *a);
+
+
+/* ACCESSORS ******************************************************************/
+// Total amount of memory reserved by the arena
+size_t arena_size(arena_t const *a);
+
+
+/* METHODS ********************************************************************/
+// Returns a zeroed and aligned memory area of the given size
+void *arena_alloc(arena_t *a, size_t size);
+// Duplicates a string into the arena
+char *arena_strdup(arena_t *a, char const *s);
+// Moves all the memory of from into a, then releases from
+void arena_merge(arena_t *a, arena_t *from);
+
+
+#endif // ARENA_H
@@ -10,7 +10,7 @@
 #include "defines.h"
 #include <ctype.h>     // toupper
 #include <math.h>      // pow
-#include <sys/param.h> // MIN
+#include <sys/param.h> // MIN, MAX
 
 /*
   ____        __ _       _ _   _
@@ -21,32 +21,41 @@
 
 */
 
-// Velocity profile data
-typedef struct {
-  data_t a, d;             // actual accelerations
-  data_t f, l;             // actual feedrate and length
-  data_t fs, fe;           // initial and final feedrate
-  data_t dt_1, dt_m, dt_2; // durations
-  data_t dt;               // total duration
-} block_profile_t;
+// Modal words: when missing in a line, their value is inherited from the
+// previous block
+#define N_SET '\1'
+#define G_SET '\2'
+#define F_SET '\4'
+#define S_SET '\10'
+#define T_SET '\20'
+
+// Steps between resyncs of the arc stepping rotation
+#define BLOCK_STEP_SYNC 256
+
+// Max bisection steps for the peak speed of jerk-limited profiles
+#define BLOCK_BISECT 64
 
 typedef struct block {
-  char *line;               // G-code line as a string
+  char const *src;          // G-code line (view, not NUL-terminated)
+  size_t src_len;           // length of the view
+  char *line;               // G-code line as a string (made on demand)
   block_type_t type;        // block type
   size_t n;                 // block number
   size_t tool;              // tool number
   data_t feedrate;          // nominal feedrate
   data_t arc_feedrate;      // actual feedrate along an arc
   data_t spindle;           // spindle rotational speed
-  point_t *target;          // target position
-  point_t *delta;           // segment projections
-  point_t *center;          // arc center coordinates
+  point_t target;           // target position
+  point_t delta;            // segment projections
+  point_t center;           // arc center coordinates
   data_t length;            // segment/arc length
   data_t i, j, r;           // arc parameters (offsets and radius)
   data_t theta_0, dtheta;   // initial angle and arc angle
   data_t acc;               // actual acceleration
+  uint8_t words;            // modal words found in the line (N_SET...)
   machine_t const *machine; // the machine reference
-  block_profile_t *prof;    // the speed profile
+  arena_t *arena;           // the memory owner (NULL for heap)
+  block_profile_t prof;     // the speed profile
   struct block *next;       // reference to the next block
   struct block *prev;       // reference to the previous block
 } block_t;
@@ -62,74 +71,119 @@ typedef struct block {
 
 /* STATIC FUNCTIONS ***********************************************************/
 static point_t *start_point(block_t const *b);
-static ccnc_error_t block_set_fields(block_t *b, char cmd, char *arg);
+static ccnc_error_t block_set_fields(block_t *b, char cmd, data_t arg);
 static void block_compute(block_t *b);
+static void block_scurve(block_t *b);
+static data_t scurve_time(data_t dv, data_t A, data_t J, data_t *dt_j);
+static data_t block_reach(block_t const *b, data_t v);
+static void block_poly(block_profile_t *prof);
 static ccnc_error_t block_arc(block_t *b);
 static data_t quantize(data_t t, data_t tq, data_t *dq);
-static ccnc_error_t block_parse(block_t *b);
+static int block_is_interp(block_t const *b);
+static void block_direction(block_t const *b, data_t lambda, data_t *u);
+static data_t block_limits(block_t *b);
+static data_t sweep_max_sin(data_t theta, data_t dtheta);
+static data_t block_junction(block_t const *b);
 
 /* LIFECYCLE ******************************************************************/
 block_t *block_new(char const *line, block_t *prev, machine_t const *machine) {
+  return block_new_in(line, prev, machine, NULL);
+}
+
+block_t *block_new_in(char const *line, block_t *prev,
+                      machine_t const *machine, arena_t *arena) {
   assert(line);
-  block_t *b = (block_t *)malloc(sizeof(block_t));
+  block_t *b = NULL;
+  char *copy = arena ? arena_strdup(arena, line) : strdup(line);
+  if (!copy) {
+    eprintf("Could not allcate memory for G-code string\n");
+    return NULL;
+  }
+  b = block_new_view(copy, strlen(copy), prev, machine, arena);
   if (!b) {
-    eprintf("Could not allocate memory for block line %s\n", line);
-    goto fail;
+    if (!arena)
+      free(copy);
+    return NULL;
   }
+  b->line = copy;
+  return b;
+}
 
-  if (prev) { // this is not the first block, copy memory from previous one
-    memcpy(b, prev, sizeof(*b));
-    b->prev = prev;
-    b->next = NULL;
-    prev->next = b;
-  } else { // this is the very first block
-    memset(b, 0, sizeof(*b));
+block_t *block_new_view(char const *src, size_t len, block_t *prev,
+                        machine_t const *machine, arena_t *arena) {
+  block_t *b = block_alloc(src, len, machine, arena);
+  if (!b)
+    return NULL;
+  if (block_lex(b) != NO_ERR || block_link(b, prev) != NO_ERR) {
+    eprintf("Could not parse block\n");
+    block_free(b);
+    return NULL;
   }
+  return b;
+}
 
+block_t *block_alloc(char const *src, size_t len, machine_t const *machine,
+                     arena_t *arena) {
+  assert(src);
+  block_t *b = NULL;
+  if (arena)
+    b = (block_t *)arena_alloc(arena, sizeof(block_t));
+  else
+    b = (block_t *)malloc(sizeof(block_t));
+  if (!b) {
+    eprintf("Could not allocate memory for block line %.*s\n", (int)len, src);
+    return NULL;
+  }
+  memset(b, 0, sizeof(*b));
+  b->src = src;
+  b->src_len = len;
   b->machine = machine;
+  b->arena = arena;
   b->acc = machine_A(machine);
+  return b;
+}
 
-  b->prof = (block_profile_t *)malloc(sizeof(block_profile_t));
-  if (!b->prof) {
-    eprintf("Could not allocate memory for velocity profile\n");
-    goto fail;
-  }
-  b->target = point_new();
-  b->delta = point_new();
-  b->center = point_new();
-  if (!b->center || !b->delta || !b->target) {
-    eprintf("Could not allocate memory for block points\n");
-    goto fail;
-  }
-  b->line = strdup(line);
-  if (!b->line) {
-    eprintf("Could not allcate memory for G-code string\n");
-    goto fail;
-  }
-  if (block_parse(b) != NO_ERR) {
-    eprintf("Could not parse block\n");
-    goto fail;
+block_t *block_load(block_record_t const *rec, char const *base,
+                    block_t *prev, machine_t const *machine, arena_t *arena) {
+  assert(rec && base);
+  block_t *b =
+      block_alloc(base + rec->src_offset, rec->src_len, machine, arena);
+  if (!b)
+    return NULL;
+  if (prev) {
+    b->prev = prev;
+    prev->next = b;
   }
+  b->n = rec->n;
+  b->tool = rec->tool;
+  b->type = (block_type_t)rec->type;
+  b->feedrate = rec->feedrate;
+  b->arc_feedrate = rec->arc_feedrate;
+  b->spindle = rec->spindle;
+  point_set_xyz(&b->target, rec->target[0], rec->target[1], rec->target[2]);
+  point_set_xyz(&b->delta, rec->delta[0], rec->delta[1], rec->delta[2]);
+  point_set_xyz(&b->center, rec->center[0], rec->center[1], rec->center[2]);
+  b->length = rec->length;
+  b->r = rec->r;
+  b->theta_0 = rec->theta_0;
+  b->dtheta = rec->dtheta;
+  b->acc = rec->acc;
+  b->prof = rec->prof;
   return b;
-
-fail:
-  if (b)
-    block_free(b);
-  return NULL;
 }
 
 void block_free(block_t *b) {
   assert(b);
+  // detach from the list
+  if (b->next && b->next->prev == b)
+    b->next->prev = NULL;
+  if (b->prev && b->prev->next == b)
+    b->prev->next = NULL;
+  // memory allocated in an arena is released with the arena
+  if (b->arena)
+    return;
   if (b->line)
     free(b->line);
-  if (b->prof)
-    free(b->prof);
-  if (b->target)
-    point_free(b->target);
-  if (b->center)
-    point_free(b->center);
-  if (b->delta)
-    point_free(b->delta);
   free(b);
   b = NULL;
 }
@@ -139,7 +193,7 @@ void block_print(block_t const *b, FILE *out) {
   char *start = NULL, *end = NULL;
   point_t *p0 = start_point(b);
   point_inspect(p0, &start);
-  point_inspect(b->target, &end);
+  point_inspect(&b->target, &end);
   fprintf(out, "%03lu %s->%s F%7.1f S%7.1f T%02lu G%02d\n", b->n, start, end,
           b->feedrate, b->spindle, b->tool, b->type);
   free(start);
@@ -157,61 +211,100 @@ void block_print(block_t const *b, FILE *out) {
 block_getter(data_t, length, length);
 block_getter(data_t, dtheta, dtheta);
 block_getter(block_type_t, type, type);
-block_getter(data_t, prof->dt, dt);
-block_getter(char *, line, line);
+block_getter(data_t, prof.dt, dt);
 block_getter(size_t, n, n);
 block_getter(data_t, r, r);
-block_getter(point_t *, center, center);
-block_getter(point_t *, target, target);
 block_getter(block_t *, next, next);
+block_getter(data_t, theta_0, theta0);
+
+char *block_line(block_t const *b) {
+  assert(b);
+  block_t *mb = (block_t *)b; // the copy is a cache
+  if (!b->line) {
+    if (b->arena)
+      mb->line = (char *)arena_alloc(b->arena, b->src_len + 1);
+    else
+      mb->line = (char *)malloc(b->src_len + 1);
+    if (!b->line) {
+      eprintf("Could not allcate memory for G-code string\n");
+      return NULL;
+    }
+    memcpy(b->line, b->src, b->src_len);
+    b->line[b->src_len] = '\0';
+  }
+  return b->line;
+}
+
+point_t *block_center(block_t const *b) {
+  assert(b);
+  return (point_t *)&b->center;
+}
+
+point_t *block_target(block_t const *b) {
+  assert(b);
+  return (point_t *)&b->target;
+}
+
+point_t *block_start(block_t const *b) {
+  return start_point(b);
+}
+
+block_profile_t const *block_profile(block_t const *b) {
+  assert(b);
+  return &b->prof;
+}
+
+void block_save(block_t const *b, char const *base, block_record_t *rec) {
+  assert(b && base && rec);
+  memset(rec, 0, sizeof(*rec));
+  rec->src_offset = (uint64_t)(b->src - base);
+  rec->src_len = b->src_len;
+  rec->n = b->n;
+  rec->tool = b->tool;
+  rec->type = b->type;
+  rec->feedrate = b->feedrate;
+  rec->arc_feedrate = b->arc_feedrate;
+  rec->spindle = b->spindle;
+  rec->target[0] = point_x(&b->target);
+  rec->target[1] = point_y(&b->target);
+  rec->target[2] = point_z(&b->target);
+  rec->delta[0] = point_x(&b->delta);
+  rec->delta[1] = point_y(&b->delta);
+  rec->delta[2] = point_z(&b->delta);
+  rec->center[0] = point_x(&b->center);
+  rec->center[1] = point_y(&b->center);
+  rec->center[2] = point_z(&b->center);
+  rec->length = b->length;
+  rec->r = b->r;
+  rec->theta_0 = b->theta_0;
+  rec->dtheta = b->dtheta;
+  rec->acc = b->acc;
+  rec->prof = b->prof;
+}
 
 /* METHODS ********************************************************************/
 
 data_t block_lambda(block_t *b, data_t t, data_t *s) {
   assert(b);
-  data_t r;
-  data_t dt_1 = b->prof->dt_1;
-  data_t dt_2 = b->prof->dt_2;
-  data_t dt_m = b->prof->dt_m;
-  data_t a = b->prof->a;
-  data_t d = b->prof->d;
-  data_t f = b->prof->f;
-
-  if (t < 0) {
-    r = 0.0;
-    *s = 0.0;
-  } else if (t < dt_1) { // acceleration
-    r = a * pow(t, 2) / 2.0;
-    *s = a * t;
-  } else if (t < dt_1 + dt_m) { // maintenance
-    r = f * (dt_1 / 2.0 + (t - dt_1));
-    *s = f;
-  } else if (t < dt_1 + dt_m + dt_2) { // deceleration
-    data_t t_2 = dt_1 + dt_m;
-    r = f * dt_1 / 2.0 + f * (dt_m + t - t_2) +
-        d / 2.0 * (pow(t, 2) + pow(t_2, 2)) - d * t * t_2;
-    *s = f + d * (t - t_2);
-  } else {
-    r = b->prof->l;
-    *s = 0.0;
-  }
-  
-  r /= b->prof->l;
-  *s *= 60; // convert to mm/min
-  return r;
+  return block_poly_lambda(&b->prof.poly, t, s);
 }
 
 point_t *block_interpolate(block_t *b, data_t lambda) {
   assert(b);
-  point_t *result = machine_setpoint(b->machine);
+  return block_interpolate_to(b, lambda, machine_setpoint(b->machine));
+}
+
+point_t *block_interpolate_to(block_t const *b, data_t lambda,
+                              point_t *result) {
+  assert(b && result);
   point_t *p0 = start_point(b);
   
-  // 1. the block describes a segment
+  // 1. the block describes a segment (also a rapid)
   // x(t) = x(0) + d_x * lambda(t)
   // y(t) = y(0) + d_y * lambda(t)
-  if (b->type == LINE) {
-    point_set_x(result, point_x(p0) + point_x(b->delta) * lambda);
-    point_set_y(result, point_y(p0) + point_y(b->delta) * lambda);
+  if (b->type == LINE || b->type == RAPID) {
+    point_set_x(result, point_x(p0) + point_x(&b->delta) * lambda);
+    point_set_y(result, point_y(p0) + point_y(&b->delta) * lambda);
   }
 
   // 2. the block describes an arc
@@ -219,13 +312,13 @@ point_t *block_interpolate(block_t *b, data_t lambda) {
   // y(t) = y_c + R sin(theta_0 + dtheta * lambda(t))
   else if (b->type == CWA || b->type == CCWA) {
     data_t angle = b->theta_0 + b->dtheta * lambda;
-    point_set_x(result, point_x(b->center) + b->r * cos(angle));
-    point_set_y(result, point_y(b->center) + b->r * sin(angle));
+    point_set_x(result, point_x(&b->center) + b->r * cos(angle));
+    point_set_y(result, point_y(&b->center) + b->r * sin(angle));
   } else {
     wprintf("Unexpected block type in interpolation\n");
     return NULL;
   }
-  point_set_z(result, point_z(p0) + point_z(b->delta) * lambda);
+  point_set_z(result, point_z(p0) + point_z(&b->delta) * lambda);
   return result;
 }
 
@@ -234,53 +327,269 @@ point_t *block_interpolate_t(block_t *b, data_t t, data_t *lambda, data_t *s) {
   return block_interpolate(b, *lambda);
 }
 
+void block_step_init(block_step_t *it, block_t const *b, size_t n) {
+  assert(it && b && n > 0);
+  it->b = b;
+  it->i = 0;
+  it->n = n;
+  if (b->type == CWA || b->type == CCWA) {
+    it->cos_d = cos(b->dtheta / n);
+    it->sin_d = sin(b->dtheta / n);
+    it->u = cos(b->theta_0);
+    it->v = sin(b->theta_0);
+  }
+}
+
+int block_step_next(block_step_t *it, point_t *p) {
+  assert(it && p);
+  block_t const *b = it->b;
+  point_t *p0 = start_point(b);
+  data_t lambda, u;
+  if (it->i > it->n)
+    return 0;
+  lambda = (data_t)it->i / it->n;
+  if (b->type == CWA || b->type == CCWA) {
+    // resync, so that rounding errors do not pile up
+    if ((it->i % BLOCK_STEP_SYNC == 0 && it->i > 0) || it->i == it->n) {
+      it->u = cos(b->theta_0 + b->dtheta * lambda);
+      it->v = sin(b->theta_0 + b->dtheta * lambda);
+    }
+    point_set_x(p, point_x(&b->center) + b->r * it->u);
+    point_set_y(p, point_y(&b->center) + b->r * it->v);
+    // rotate by dtheta / n
+    u = it->u * it->cos_d - it->v * it->sin_d;
+    it->v = it->v * it->cos_d + it->u * it->sin_d;
+    it->u = u;
+  } else {
+    point_set_x(p, point_x(p0) + point_x(&b->delta) * lambda);
+    point_set_y(p, point_y(p0) + point_y(&b->delta) * lambda);
+  }
+  point_set_z(p, point_z(p0) + point_z(&b->delta) * lambda);
+  it->i++;
+  return 1;
+}
+
+// Junction speed planning over the last window blocks ending with b, under 
+// the assumption that the machine must come to a stop at the end of b.
+// The backward pass limits the initial speeds so that each block can 
+// decelerate to the next one; the forward pass limits the final speeds to 
+// what can be reached by accelerating from the previous junction. Blocks 
+// that fall out of the window keep their profile.
+// Profiles are only computed once their junction speeds are final, that is
+// when a block falls out of the window or the chain of interpolated blocks
+// is interrupted: the last blocks of a program need block_lookahead_end().
+void block_lookahead(block_t *b, size_t window) {
+  assert(b);
+  block_t *k, *first = NULL;
+  size_t i;
+  data_t v = 0.0; // speed at the end of the current block (mm/s)
+
+  // 1. backward pass
+  for (k = b, i = 0; k && i < window && block_is_interp(k); k = k->prev, i++) {
+    k->prof.fe = v;
+    k->prof.fs = MIN(k->prof.vj, block_reach(k, v));
+    v = k->prof.fs;
+    first = k;
+  }
+  if (!first) { // the preceding blocks will not change anymore
+    if (b->prev)
+      block_lookahead_end(b->prev, window);
+    return;
+  }
+
+  // 2. forward pass
+  // the block preceding the window has already been planned, so its final 
+  // speed is the bound for the first block in the window
+  k = first->prev;
+  v = (k && block_is_interp(k)) ? k->prof.fe : 0.0;
+  for (k = first; k; k = k->next) {
+    k->prof.fs = MIN(k->prof.fs, v);
+    k->prof.fe = MIN(k->prof.fe, block_reach(k, k->prof.fs));
+    v = k->prof.fe;
+    if (k == b)
+      break;
+  }
+  // the next block can reach back to window - 1 blocks before it
+  if (i == window)
+    block_compute(first);
+}
+
+// Computes the profiles of the blocks still within the window
+void block_lookahead_end(block_t *b, size_t window) {
+  assert(b);
+  block_t *k;
+  size_t i;
+  for (k = b, i = 0; k && i < window && block_is_interp(k); k = k->prev, i++) {
+    block_compute(k);
+  }
+}
+
 /* STATIC FUNCTIONS
  * ***********************************************************/
 
 static point_t *start_point(block_t const *b) {
   assert(b);
-  return b->prev ? b->prev->target : machine_zero(b->machine);
+  return b->prev ? (point_t *)&b->prev->target : machine_zero(b->machine);
 }
 
+// Exact powers of ten, for the decimal parser
+static const data_t pow10_tab[] = {1E0,  1E1,  1E2,  1E3,  1E4,  1E5,
+                                   1E6,  1E7,  1E8,  1E9,  1E10, 1E11,
+                                   1E12, 1E13, 1E14, 1E15, 1E16, 1E17,
+                                   1E18, 1E19, 1E20, 1E21, 1E22};
+
+// Longest number handed over to strtod() (longer ones are approximated)
+#define SCAN_NUMBER_MAX 64
+
+// Locale-independent decimal parser: [+-]digits[.digits]. Digits are
+// accumulated in an integer and scaled once. When both the integer (up to
+// 2^53) and the power of ten (up to 1E22) are exact doubles, that is a
+// single, correctly rounded operation; longer mantissas fall back to
+// strtod(). Returns a pointer past the number, or NULL if there are no
+// digits. Scanning stops at end.
+static char const *scan_number(char const *c, char const *end, data_t *val) {
+  char const *start = c;
+  char buf[SCAN_NUMBER_MAX + 1];
+  uint64_t mant = 0;
+  int neg = 0, digits = 0, sig = 0, frac = 0, exp = 0;
+  if (c < end && (*c == '-' || *c == '+'))
+    neg = (*c++ == '-');
+  for (; c < end && *c >= '0' && *c <= '9'; c++, digits++) {
+    if (sig < 19) {
+      mant = mant * 10 + (uint64_t)(*c - '0');
+      sig += (mant > 0);
+    } else {
+      exp++;
+    }
+  }
+  if (c < end && *c == '.') {
+    for (c++; c < end && *c >= '0' && *c <= '9'; c++, digits++) {
+      if (sig < 19) {
+        mant = mant * 10 + (uint64_t)(*c - '0');
+        sig += (mant > 0);
+        frac++;
+      }
+    }
+  }
+  if (digits == 0)
+    return NULL;
+  exp -= frac;
+  if ((mant > (1ULL << 53) || exp < -22 || exp > 22) &&
+      c - start <= SCAN_NUMBER_MAX) {
+    memcpy(buf, start, c - start);
+    buf[c - start] = '\0';
+    *val = strtod(buf, NULL); // the C locale is never changed
+    return c;
+  }
+  *val = (data_t)mant;
+  while (exp < -22) {
+    *val /= 1E22;
+    exp += 22;
+  }
+  if (exp < 0)
+    *val /= pow10_tab[-exp];
+  else if (exp > 0)
+    *val *= pow10_tab[MIN(exp, 22)];
+  if (neg)
+    *val = -*val;
+  return c;
+}
+
+#define is_blank(c)                                                            \
+  ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n' || (c) == '\v' ||   \
+   (c) == '\f')
+
 // "N01 G00 Z1000 Y500.10 T25 S5000 X123.321"
-static ccnc_error_t block_parse(block_t *b) {
+// Single pass, allocation-free scanner: words are a letter followed by a
+// number, and can be separated by blanks or packed together ("G01X10Y5").
+// Text within parentheses and after a semicolon is a comment. A lone
+// character with no number (e.g. a "%" program delimiter) is skipped.
+ccnc_error_t block_lex(block_t *b) {
   assert(b);
-  char *word, *line, *to_free;
+  char const *c = b->src, *end = b->src + b->src_len, *arg;
+  char cmd;
+  data_t val;
   ccnc_error_t error = NO_ERR;
-  point_t *p0;
-
-  to_free = line = strdup(b->line);
-  if (!line) {
-    eprintf("Could not duplicate G-code line %s\n", b->line);
-    return ALLOC_ERR;
-  }
 
   // Tokenization
-  // We shall remove any spaces at the end of the line before tokeinzing it
-  while ((word = strsep(&line, " ")) != NULL) {
-    // A valid command has at least two letters (e.g. G0)
-    // This also skips double spaces or spaces at the end of the line
-    if (strlen(word) < 2)
+  while (c < end && error == NO_ERR) {
+    if (is_blank(*c)) {
+      c++;
       continue;
-    // word[0] is the G-code command
-    // word + 1 is the argument
-    error = block_set_fields(b, toupper(word[0]), word + 1);
-    if (error != NO_ERR)
+    }
+    if (*c == ';')
       break;
+    if (*c == '(') {
+      while (c < end && *c != ')')
+        c++;
+      if (c == end) {
+        wprintf("Unterminated comment in %.*s\n", (int)b->src_len, b->src);
+        return PARSE_ERR;
+      }
+      c++;
+      continue;
+    }
+    // *c is the G-code command, followed by its argument
+    cmd = toupper(*c++);
+    arg = c;
+    while (c < end && (*c == ' ' || *c == '\t'))
+      c++;
+    if (cmd == 'F' && end - c >= 3 && toupper(c[0]) == 'M' &&
+        toupper(c[1]) == 'A' && toupper(c[2]) == 'X') { // also support "FMAX"
+      val = machine_fmax(b->machine);
+      c += 3;
+    } else if (!(c = scan_number(c, end, &val))) {
+      if (arg == end || is_blank(*arg) || *arg == ';' || *arg == '(') {
+        c = arg;
+        continue;
+      }
+      wprintf("Missing argument for G-code command \"%c\"\n", cmd);
+      return PARSE_ERR;
+    }
+    error = block_set_fields(b, cmd, val);
+  }
+  return error;
+}
+
+ccnc_error_t block_link(block_t *b, block_t *prev) {
+  assert(b);
+  ccnc_error_t error = NO_ERR;
+  point_t *p0;
+
+  if (prev) { // this is not the first block, inherit the modal state
+    b->prev = prev;
+    prev->next = b;
+    if (!(b->words & N_SET))
+      b->n = prev->n;
+    if (!(b->words & G_SET))
+      b->type = prev->type;
+    if (!(b->words & F_SET))
+      b->feedrate = prev->feedrate;
+    if (!(b->words & S_SET))
+      b->spindle = prev->spindle;
+    if (!(b->words & T_SET))
+      b->tool = prev->tool;
+    b->arc_feedrate = prev->arc_feedrate;
+    b->theta_0 = prev->theta_0;
+    b->dtheta = prev->dtheta;
   }
-  free(to_free);
 
   // Inherit coords from prev block
   p0 = start_point(b);
-  point_modal(p0, b->target);
-  point_delta(p0, b->target, b->delta);
-  b->length = point_dist(p0, b->target);
+  point_modal(p0, &b->target);
+  point_delta(p0, &b->target, &b->delta);
+  b->length = point_dist(p0, &b->target);
+  b->prof.fs = b->prof.fe = 0.0;
 
   // Deal with motion blocks
   switch (b->type) {
+  case RAPID: // G00, planned at fmax (the junctions are at rest)
+    b->arc_feedrate = block_limits(b);
+    block_compute(b);
+    break;
   case LINE: // G01
-    b->acc = machine_A(b->machine);
-    b->arc_feedrate = b->feedrate;
+    b->arc_feedrate = MIN(b->feedrate, block_limits(b));
+    b->prof.vj = block_junction(b);
     block_compute(b);
     break;
   case CWA:  // G02
@@ -290,10 +599,11 @@ static ccnc_error_t block_parse(block_t *b) {
       error = ARC_ERR;
       break;
     }
-    b->arc_feedrate = MIN(
-        b->feedrate,
-        pow(3.0 / 4.0 * pow(machine_A(b->machine), 2) * pow(b->r, 2), 0.25) *
-            60);
+    b->arc_feedrate = MIN(b->feedrate, block_limits(b));
+    b->arc_feedrate =
+        MIN(b->arc_feedrate,
+            pow(3.0 / 4.0 * pow(b->acc, 2) * pow(b->r, 2), 0.25) * 60);
+    b->prof.vj = block_junction(b);
     block_compute(b);
     break;
   default:
@@ -302,45 +612,54 @@ static ccnc_error_t block_parse(block_t *b) {
   return error;
 }
 
-static ccnc_error_t block_set_fields(block_t *b, char cmd, char *arg) {
-  assert(b && arg);
+static ccnc_error_t block_set_fields(block_t *b, char cmd, data_t arg) {
+  assert(b);
   switch (cmd) {
   case 'N':
-    b->n = atol(arg);
+    if (arg < 0) {
+      eprintf("Negative block number N%g\n", arg);
+      return PARSE_ERR;
+    }
+    b->n = (size_t)arg;
+    b->words |= N_SET;
     break;
   case 'G':
-    b->type = (block_type_t)atoi(arg);
+    b->type = (block_type_t)(int)arg;
+    b->words |= G_SET;
     break;
   case 'X':
-    point_set_x(b->target, atof(arg));
+    point_set_x(&b->target, arg);
     break;
   case 'Y':
-    point_set_y(b->target, atof(arg));
+    point_set_y(&b->target, arg);
     break;
   case 'Z':
-    point_set_z(b->target, atof(arg));
+    point_set_z(&b->target, arg);
     break;
   case 'I':
-    b->i = atof(arg);
+    b->i = arg;
     break;
   case 'J':
-    b->j = atof(arg);
+    b->j = arg;
     break;
   case 'R':
-    b->r = atof(arg);
+    b->r = arg;
     break;
-  case 'F': // also support "FMAX"
-    if (strcmp(arg, "MAX") == 0) {
-      b->feedrate = machine_fmax(b->machine);
-    } else {
-      b->feedrate = MIN(atof(arg), machine_fmax(b->machine));
-    }
+  case 'F':
+    b->feedrate = MIN(arg, machine_fmax(b->machine));
+    b->words |= F_SET;
     break;
   case 'S':
-    b->spindle = atof(arg);
+    b->spindle = arg;
+    b->words |= S_SET;
     break;
   case 'T':
-    b->tool = atol(arg);
+    if (arg < 0) {
+      eprintf("Negative tool number T%g\n", arg);
+      return PARSE_ERR;
+    }
+    b->tool = (size_t)arg;
+    b->words |= T_SET;
     break;
   default:
     wprintf("Unsupported G-code command \"%c\"\n", cmd);
@@ -360,40 +679,290 @@ static data_t quantize(data_t t, data_t tq, data_t *dq) {
   return q;
 }
 
+// Computes the velocity profile for the initial and final feedrates 
+// prof->fs and prof->fe (mm/s). Blocks starting and ending at rest have 
+// their duration quantized to a multiple of tq, as the interpolation ends 
+// on a sampling instant. Blocks with non-zero junction speeds keep their 
+// exact duration, for stretching them would require a lower junction speed.
+// In continuous time ([C-CNC]:continuous), no block is quantized: the
+// trajectory generator carries the sampling instants across blocks.
+// With a max jerk ([C-CNC]:J > 0), the profile is an S-curve instead
 static void block_compute(block_t *b) {
   assert(b);
   data_t A, a, d;
   data_t dt, dt_1, dt_2, dt_m, dq;
-  data_t f_m, l;
+  data_t f_m, l, fs, fe;
+  int quantized = !machine_continuous(b->machine);
 
+  if (machine_J(b->machine) > 0) {
+    block_scurve(b);
+    return;
+  }
   A = b->acc;
   f_m = b->arc_feedrate / 60.0;
   l = b->length;
-  dt_1 = f_m / A;
-  dt_2 = dt_1;
-  dt_m = l / f_m - (dt_1 + dt_2) / 2.0;
+  fs = b->prof.fs;
+  fe = b->prof.fe;
+  dt_1 = (f_m - fs) / A;
+  dt_2 = (f_m - fe) / A;
+  dt_m = l / f_m - (dt_1 * (f_m + fs) + dt_2 * (f_m + fe)) / (2 * f_m);
 
   if (dt_m > 0) { // Trapezoidal profile
-    dt = quantize(dt_1 + dt_m + dt_2, machine_tq(b->machine), &dq);
-    dt_m = dt_m + dq;
-    f_m = (2 * l) / (dt_1 + dt_2 + 2 * dt_m);
+    if (fs == 0 && fe == 0 && quantized) {
+      dt = quantize(dt_1 + dt_m + dt_2, machine_tq(b->machine), &dq);
+      dt_m = dt_m + dq;
+      f_m = (2 * l) / (dt_1 + dt_2 + 2 * dt_m);
+    } else {
+      dt = dt_1 + dt_m + dt_2;
+    }
   } else { // Triangular profile
-    dt_1 = dt_2 = sqrt(l / A);
-    dt = quantize(dt_1 + dt_2, machine_tq(b->machine), &dq);
+    f_m = sqrt(A * l + (pow(fs, 2) + pow(fe, 2)) / 2.0);
+    f_m = MAX(f_m, MAX(fs, fe));
+    dt_1 = (f_m - fs) / A;
+    dt_2 = (f_m - fe) / A;
     dt_m = 0;
-    dt_2 = dt_2 + dq;
-    f_m = 2 * l / (dt_1 + dt_2);
+    if (fs == 0 && fe == 0 && quantized) {
+      dt = quantize(dt_1 + dt_2, machine_tq(b->machine), &dq);
+      dt_2 = dt_2 + dq;
+      f_m = 2 * l / (dt_1 + dt_2);
+    } else {
+      dt = dt_1 + dt_2;
+    }
+  }
+  a = dt_1 > 0 ? (f_m - fs) / dt_1 : 0.0;
+  d = dt_2 > 0 ? (fe - f_m) / dt_2 : 0.0;
+  b->prof.dt_1 = dt_1;
+  b->prof.dt_2 = dt_2;
+  b->prof.dt_m = dt_m;
+  b->prof.dt_j1 = b->prof.dt_j2 = 0.0;
+  b->prof.a = a;
+  b->prof.d = d;
+  b->prof.f = f_m;
+  b->prof.dt = dt;
+  b->prof.l = l;
+  block_poly(&b->prof);
+}
+
+// Jerk-limited (7 phases) velocity profile: each speed change has a jerk
+// phase up to the acceleration, an optional constant acceleration phase,
+// and a jerk phase back to zero acceleration. Such a change covers the
+// mean speed times its duration, so the feedrate of short blocks is found
+// by bisection. Blocks starting and ending at rest are quantized by
+// stretching the time, which lowers speed, acceleration and jerk alike
+static void block_scurve(block_t *b) {
+  assert(b);
+  data_t A = b->acc, J = machine_J(b->machine);
+  data_t l = b->length, fs = b->prof.fs, fe = b->prof.fe;
+  data_t f_m = b->arc_feedrate / 60.0, lo, hi, dt_1, dt_2, dt_m, dt_j1, dt_j2;
+  data_t dt, dq, r;
+  int i;
+
+#define SCURVE_LEN(f)                                                          \
+  ((fs + (f)) / 2.0 * scurve_time((f) - fs, A, J, &dt_j1) +                    \
+   ((f) + fe) / 2.0 * scurve_time((f) - fe, A, J, &dt_j2))
+  if (SCURVE_LEN(f_m) > l) { // no maintenance: the peak speed is lower
+    // than in the triangular profile with infinite jerk
+    lo = MAX(fs, fe);
+    hi = MIN(f_m, sqrt(A * l + (pow(fs, 2) + pow(fe, 2)) / 2.0));
+    for (i = 0; i < BLOCK_BISECT && hi - lo > 1E-12 * hi; i++) {
+      f_m = (lo + hi) / 2.0;
+      if (SCURVE_LEN(f_m) > l)
+        hi = f_m;
+      else
+        lo = f_m;
+    }
+    f_m = lo;
+  }
+  dt_1 = scurve_time(f_m - fs, A, J, &dt_j1);
+  dt_2 = scurve_time(f_m - fe, A, J, &dt_j2);
+  dt_m = f_m > 0 ? MAX(l - SCURVE_LEN(f_m), 0.0) / f_m : 0.0;
+#undef SCURVE_LEN
+  dt = dt_1 + dt_m + dt_2;
+  b->prof.a = dt_1 > 0 ? (f_m - fs) / (dt_1 - dt_j1) : 0.0;
+  b->prof.d = dt_2 > 0 ? (fe - f_m) / (dt_2 - dt_j2) : 0.0;
+  if (fs == 0 && fe == 0 && !machine_continuous(b->machine) && dt > 0) {
+    r = quantize(dt, machine_tq(b->machine), &dq) / dt;
+    dt *= r;
+    dt_1 *= r;
+    dt_2 *= r;
+    dt_m *= r;
+    dt_j1 *= r;
+    dt_j2 *= r;
+    f_m /= r;
+    b->prof.a /= r * r;
+    b->prof.d /= r * r;
+  }
+  b->prof.dt_1 = dt_1;
+  b->prof.dt_2 = dt_2;
+  b->prof.dt_m = dt_m;
+  b->prof.dt_j1 = dt_j1;
+  b->prof.dt_j2 = dt_j2;
+  b->prof.f = f_m;
+  b->prof.dt = dt;
+  b->prof.l = l;
+  block_poly(&b->prof);
+}
+
+// Duration of a jerk-limited speed change by dv, and of each of its jerk
+// phases (dt_j): the acceleration A is reached only for large changes
+static data_t scurve_time(data_t dv, data_t A, data_t J, data_t *dt_j) {
+  dv = fabs(dv);
+  if (dv >= A * A / J) {
+    *dt_j = A / J;
+    return dv / A + A / J;
   }
-  a = f_m / dt_1;
-  d = -(f_m / dt_2);
-  b->prof->dt_1 = dt_1;
-  b->prof->dt_2 = dt_2;
-  b->prof->dt_m = dt_m;
-  b->prof->a = a;
-  b->prof->d = d;
-  b->prof->f = f_m;
-  b->prof->dt = dt;
-  b->prof->l = l;
+  *dt_j = sqrt(dv / J);
+  return 2.0 * *dt_j;
+}
+
+// Max speed (mm/s) reachable along b when starting (or ending) at speed v,
+// for the look-ahead passes. In closed form, for it is evaluated over the
+// whole window for every new block
+static data_t block_reach(block_t const *b, data_t v) {
+  assert(b);
+  data_t A = b->acc, J = machine_J(b->machine), l = b->length;
+  data_t q, r, x;
+  if (J <= 0)
+    return sqrt(pow(v, 2) + 2 * A * l);
+  q = A * A / J; // smallest speed change reaching the acceleration A
+  if (l >= (2 * v + q) * A / J) // (v + f) (f - v + q) / (2 A) = l
+    return (sqrt(q * q + 4 * (v * v - v * q + 2 * A * l)) - q) / 2.0;
+  // otherwise (2 v + dv) sqrt(dv / J) = l: with dv = x^2, it is the cubic
+  // x^3 + 2 v x = l sqrt(J), solved with Cardano's formula and refined with
+  // a Newton step (the formula cancels out when v is large)
+  q = l * sqrt(J) / 2.0;
+  r = 2 * v / 3.0;
+  r = sqrt(q * q + r * r * r);
+  x = cbrt(q + r) + cbrt(q - r);
+  x -= (x * x * x + 2 * v * x - 2 * q) / (3 * x * x + 2 * v);
+  return v + x * x;
+}
+
+// Per-phase polynomials of the profile (see block_poly_t): each phase has
+// a constant jerk, and the length, speed and acceleration at its end are
+// the initial values of the next one. Speeds are converted to mm/min
+static void block_poly(block_profile_t *prof) {
+  assert(prof);
+  block_poly_t *p = &prof->poly;
+  data_t k = prof->l > 0 ? 1.0 / prof->l : 0.0;
+  data_t j1 = prof->dt_j1 > 0 ? prof->a / prof->dt_j1 : 0.0;
+  data_t j2 = prof->dt_j2 > 0 ? prof->d / prof->dt_j2 : 0.0;
+  data_t dt[7] = {prof->dt_j1, prof->dt_1 - 2 * prof->dt_j1, prof->dt_j1,
+                  prof->dt_m,  prof->dt_j2, prof->dt_2 - 2 * prof->dt_j2,
+                  prof->dt_j2};
+  data_t acc[7] = {0.0, prof->a, prof->a, 0.0, 0.0, prof->d, prof->d};
+  data_t jerk[7] = {j1, 0.0, -j1, 0.0, j2, 0.0, -j2};
+  data_t t = 0.0, s = 0.0, v = prof->fs, tau;
+  int i;
+  for (i = 0; i < 7; i++) {
+    if (i == 3) // end of acceleration, exactly
+      v = prof->f;
+    tau = MAX(dt[i], 0.0);
+    p->t[i] = t;
+    p->c[i][0] = s * k;
+    p->c[i][1] = v * k;
+    p->c[i][2] = acc[i] / 2.0 * k;
+    p->c[i][3] = jerk[i] / 6.0 * k;
+    p->v[i][0] = v * 60;
+    p->v[i][1] = acc[i] * 60;
+    p->v[i][2] = jerk[i] / 2.0 * 60;
+    s += (v + (acc[i] / 2.0 + jerk[i] / 6.0 * tau) * tau) * tau;
+    v += (acc[i] + jerk[i] / 2.0 * tau) * tau;
+    t += tau;
+  }
+  p->t[7] = t;
+  p->ve = prof->fe * 60;
+}
+
+static int block_is_interp(block_t const *b) {
+  assert(b);
+  return (b->type == LINE || b->type == CWA || b->type == CCWA) &&
+         b->length > 0;
+}
+
+// Unit vector tangent to the block path at lambda, i.e. dP/dlambda / length
+static void block_direction(block_t const *b, data_t lambda, data_t *u) {
+  assert(b && u);
+  if (b->type == LINE) {
+    u[0] = point_x(&b->delta) / b->length;
+    u[1] = point_y(&b->delta) / b->length;
+  } else {
+    data_t angle = b->theta_0 + b->dtheta * lambda;
+    u[0] = -b->r * b->dtheta * sin(angle) / b->length;
+    u[1] = b->r * b->dtheta * cos(angle) / b->length;
+  }
+  u[2] = point_z(&b->delta) / b->length;
+}
+
+// Sets the max acceleration of b and returns its max feedrate (mm/min),
+// from the per-axis limits: an axis covering a fraction |u_i| of the path
+// allows up to its own limit divided by |u_i| along the path, which is
+// further limited by C-CNC:A and C-CNC:fmax. Arcs take the largest |u_i|
+// over the swept angle for the feedrate, while their acceleration, which
+// points anywhere in the arc plane, is limited by the slowest of X and Y
+static data_t block_limits(block_t *b) {
+  assert(b);
+  point_t const *axis_A = machine_axis_A(b->machine);
+  point_t const *axis_f = machine_axis_fmax(b->machine);
+  data_t A[3] = {point_x(axis_A), point_y(axis_A), point_z(axis_A)};
+  data_t F[3] = {point_x(axis_f), point_y(axis_f), point_z(axis_f)};
+  data_t u[3], k, acc = machine_A(b->machine), f = machine_fmax(b->machine);
+  int i, arc = (b->type == CWA || b->type == CCWA);
+  if (b->length > 0) {
+    if (arc) {
+      k = fabs(b->r * b->dtheta) / b->length;
+      u[0] = k * sweep_max_sin(b->theta_0, b->dtheta);
+      u[1] = k * sweep_max_sin(b->theta_0 + M_PI_2, b->dtheta);
+    } else {
+      u[0] = fabs(point_x(&b->delta)) / b->length;
+      u[1] = fabs(point_y(&b->delta)) / b->length;
+    }
+    u[2] = fabs(point_z(&b->delta)) / b->length;
+    for (i = 0; i < 3; i++) {
+      if (u[i] > 0)
+        f = MIN(f, F[i] / u[i]);
+      if (arc && i < 2)
+        acc = MIN(acc, A[i]);
+      else if (u[i] > 0)
+        acc = MIN(acc, A[i] / u[i]);
+    }
+  }
+  b->acc = acc;
+  return f;
+}
+
+// Largest |sin(theta)| over the angles from theta to theta + dtheta
+static data_t sweep_max_sin(data_t theta, data_t dtheta) {
+  data_t lo = MIN(theta, theta + dtheta), hi = MAX(theta, theta + dtheta);
+  // first peak of |sin| from lo on
+  if (M_PI_2 + ceil((lo - M_PI_2) / M_PI) * M_PI <= hi)
+    return 1.0;
+  return MAX(fabs(sin(lo)), fabs(sin(hi)));
+}
+
+// Max speed (mm/s) at the junction with the previous block, such that the 
+// path, rounded with a circular blend within the max positioning error, 
+// can be followed with the max acceleration
+static data_t block_junction(block_t const *b) {
+  assert(b);
+  data_t u0[3], u1[3], cos_theta, sin_theta_2, v;
+  data_t A = b->acc;
+  data_t delta = machine_max_error(b->machine);
+  if (!b->prev || !block_is_interp(b->prev) || !block_is_interp(b))
+    return 0.0;
+  block_direction(b->prev, 1.0, u0);
+  block_direction(b, 0.0, u1);
+  // theta is the angle between the reversed incoming direction and the 
+  // outgoing one: it is PI for collinear blocks and 0 for a reversal
+  cos_theta = -(u0[0] * u1[0] + u0[1] * u1[1] + u0[2] * u1[2]);
+  v = MIN(b->prev->arc_feedrate, b->arc_feedrate) / 60.0;
+  if (cos_theta > 0.999999) {
+    return 0.0;
+  } else if (cos_theta > -0.999999) {
+    sin_theta_2 = sqrt(0.5 * (1.0 - cos_theta));
+    v = MIN(v, sqrt(A * delta * sin_theta_2 / (1.0 - sin_theta_2)));
+  }
+  return v;
 }
 
 static ccnc_error_t block_arc(block_t *b) {
@@ -403,13 +972,13 @@ static ccnc_error_t block_arc(block_t *b) {
   x0 = point_x(p0);
   y0 = point_y(p0);
   z0 = point_z(p0);
-  xf = point_x(b->target);
-  yf = point_y(b->target);
-  zf = point_z(b->target);
+  xf = point_x(&b->target);
+  yf = point_y(&b->target);
+  zf = point_z(&b->target);
 
   if (b->r) { // if the radius is given
-    data_t dx = point_x(b->delta);
-    data_t dy = point_y(b->delta);
+    data_t dx = point_x(&b->delta);
+    data_t dy = point_y(&b->delta);
     r = b->r;
     data_t dxy2 = pow(dx, 2) + pow(dy, 2);
     data_t sq = sqrt(-pow(dy, 2) * dxy2 * (dxy2 - 4 * r * r));
@@ -428,15 +997,15 @@ static ccnc_error_t block_arc(block_t *b) {
     xc = x0 + b->i;
     yc = y0 + b->j;
     r2 = hypot(xf - xc, yf - yc);
-    if (fabs(r - r2) > machine_error(b->machine)) {
+    if (fabs(r - r2) > machine_max_error(b->machine)) {
       fprintf(stderr, "Arc endpoints mismatch error (%f)\n", r - r2);
       block_print(b, stderr);
       return 1;
     }
     b->r = r;
   }
-  point_set_x(b->center, xc);
-  point_set_y(b->center, yc);
+  point_set_x(&b->center, xc);
+  point_set_y(&b->center, yc);
   b->theta_0 = atan2(y0 - yc, x0 - xc);
   b->dtheta = atan2(yf - yc, xf - xc) - b->theta_0;
   // we need the net angle so we take the 2PI complement if negative
@@ -467,7 +1036,10 @@ static ccnc_error_t block_arc(block_t *b) {
 
 int main(int argc, char const **argv) {
   machine_t *m = machine_new(argv[1]);
-  block_t *b1 = NULL, *b2 = NULL, *b3 = NULL, *b4 = NULL;
+  block_t *b1 = NULL, *b2 = NULL, *b3 = NULL, *b4 = NULL, *b5 = NULL;
+  block_t *b6 = NULL, *b7 = NULL;
+  char const *text = "N60 G01 X10Y99";
+  int result = 0;
   if (!m) {
     eprintf("Could not create the machine object\n");
     exit(EXIT_FAILURE);
@@ -477,11 +1049,20 @@ int main(int argc, char const **argv) {
   b2 = block_new("N20 G01 y100 S2000", b1, m);
   b3 = block_new("N30 G01 Y200", b2, m);
   b4 = block_new("N40 G00 x0 y0 z0", b3, m);
+  // packed words, tabs and comments
+  b5 = block_new("N50\tG01X-10.5Y.25 (to the corner)\tFMAX ; rapid feed", b4, m);
+  // view of the first 11 chars only: Y99 is not part of the block
+  b6 = block_new_view(text, 11, b5, m, NULL);
 
   block_print(b1, stderr);
   block_print(b2, stderr);
   block_print(b3, stderr);
   block_print(b4, stderr);
+  block_print(b5, stderr);
+  block_print(b6, stderr);
+  fprintf(stderr, "Block N60 line: \"%s\"\n", block_line(b6));
+  b7 = block_new("N70 G03 X40 Y0 I15 J-0 F1000", b6, m);
+  block_print(b7, stderr);
 
   wprintf("Interpolation of block N20 (duration: %f s)\n", block_dt(b2));
   {
@@ -498,12 +1079,86 @@ int main(int argc, char const **argv) {
     }
   }
 
+  // arc stepping must follow block_interpolate_to() within the drift bound
+  {
+    block_step_t it;
+    point_t p, q;
+    size_t i = 0, n = 100000;
+    data_t err = 0;
+    block_step_init(&it, b7, n);
+    while (block_step_next(&it, &p)) {
+      block_interpolate_to(b7, (data_t)i++ / n, &q);
+      err = fmax(err, point_dist(&p, &q));
+    }
+    fprintf(stderr, "Arc stepping: %zu points, max drift %g mm\n", i, err);
+    if (i != n + 1 || err > 1E-12 * block_r(b7)) {
+      eprintf("Arc stepping drifted\n");
+      result = EXIT_FAILURE;
+    }
+  }
+
+  // the profiles must be continuous and within the acceleration (and jerk)
+  // limits: checked by finite differences on a fine grid
+  {
+    block_t *bs[] = {b2, b3, b7};
+    data_t A = machine_A(m), J = machine_J(m);
+    data_t h, t, l, v, v0, v1, a0, a1, acc = 0, jerk = 0, gap = 0;
+    size_t i, k, n = 100000;
+    for (i = 0; i < sizeof(bs) / sizeof(*bs); i++) {
+      h = block_dt(bs[i]) / n;
+      v0 = v1 = a0 = 0.0;
+      for (k = 0; k <= n; k++) {
+        t = k * h;
+        l = block_lambda(bs[i], t, &v);
+        v /= 60.0;
+        a1 = (v - v1) / h;
+        if (k > 0)
+          acc = fmax(acc, fabs(a1) / A);
+        if (k > 1 && J > 0)
+          jerk = fmax(jerk, fabs(a1 - a0) / h / J);
+        if (k > 0)
+          gap = fmax(gap, fabs(l - v0));
+        v0 = l;
+        v1 = v;
+        a0 = a1;
+      }
+      gap = fmax(gap, fabs(v0 - 1.0));
+    }
+    fprintf(stderr,
+            "Profiles: max acceleration %.4f A, max jerk %.4f J, max lambda "
+            "step %g\n", acc, jerk, gap);
+    if (acc > 1.0 + 1E-6 || jerk > 1.0 + 1E-3 || gap > 1E-3) {
+      eprintf("Velocity profile out of limits\n");
+      result = EXIT_FAILURE;
+    }
+  }
+
+  // program delimiters are skipped, negative block and tool numbers rejected
+  {
+    block_t *b = block_new("%", NULL, m), *neg_n = NULL, *neg_t = NULL;
+    neg_n = block_new("N-10 G01 X1", NULL, m);
+    neg_t = block_new("N10 G01 X1 T-3", NULL, m);
+    if (!b || neg_n || neg_t) {
+      eprintf("Wrong handling of non-command words or negative N/T\n");
+      result = EXIT_FAILURE;
+    }
+    if (b)
+      block_free(b);
+    if (neg_n)
+      block_free(neg_n);
+    if (neg_t)
+      block_free(neg_t);
+  }
+
   block_free(b1);
   block_free(b2);
   block_free(b3);
   block_free(b4);
+  block_free(b5);
+  block_free(b6);
+  block_free(b7);
   machine_free(m);
-  return 0;
+  return result;
 }
 
 #endif // BLOCK_MAIN
\ No newline at end of file
@@ -12,6 +12,8 @@
 #include "defines.h"
 #include "point.h"
 #include "machine.h"
+#include "arena.h"
+#include <math.h>
 
 /*
   ____            _                 _   _                 
@@ -32,6 +34,59 @@ typedef enum {
   NO_MOTION
 } block_type_t;
 
+// Iterator over points evenly spaced in lambda along a block, see
+// block_step_init(); the fields are private
+typedef struct {
+  block_t const *b;    // the block
+  size_t i, n;         // next step and number of steps
+  data_t cos_d, sin_d; // rotation by one step (arcs)
+  data_t u, v;         // cosine and sine of the current angle (arcs)
+} block_step_t;
+
+// Velocity profile as per-phase polynomials in normalized lambda space: the
+// phase k starts at t[k], and within it
+// lambda = c[k][0] + (c[k][1] + (c[k][2] + c[k][3] * tau) * tau) * tau and
+// the speed is v[k][0] + (v[k][1] + v[k][2] * tau) * tau (mm/min), with
+// tau = t - t[k]. The seven phases are: jerk up, constant acceleration,
+// jerk down, maintenance, and the same three for the deceleration; the
+// jerk phases last zero in trapezoidal profiles. The profile ends at t[7],
+// with speed ve (mm/min)
+typedef struct {
+  data_t t[8];    // phase start times, and end time
+  data_t c[7][4]; // lambda coefficients
+  data_t v[7][3]; // speed coefficients
+  data_t ve;      // final speed
+} block_poly_t;
+
+// Velocity profile data (lengths in mm, times in s, speeds in mm/s)
+typedef struct {
+  data_t a, d;             // actual (peak) accelerations
+  data_t f, l;             // actual feedrate and length
+  data_t fs, fe;           // initial and final feedrate
+  data_t vj;               // max junction speed with previous block
+  data_t dt_1, dt_m, dt_2; // durations
+  data_t dt_j1, dt_j2;     // jerk phases within dt_1 and dt_2 (0: trapezoid)
+  data_t dt;               // total duration
+  block_poly_t poly;       // the same, ready for interpolation
+} block_profile_t;
+
+// Flat copy of a parsed block, for on-disk caches: the G-code line is
+// stored as a view relative to the start of the G-code text
+typedef struct {
+  uint64_t src_offset, src_len;  // G-code line view
+  uint64_t n, tool;              // block and tool numbers
+  int64_t type;                  // block type
+  data_t feedrate, arc_feedrate; // nominal and actual feedrates
+  data_t spindle;                // spindle speed
+  data_t target[3];              // target position
+  data_t delta[3];               // segment projections
+  data_t center[3];              // arc center
+  data_t length, r;              // segment/arc length and radius
+  data_t theta_0, dtheta;        // initial angle and arc angle
+  data_t acc;                    // actual acceleration
+  block_profile_t prof;          // the speed profile
+} block_record_t;
+
 /*
   _____                 _   _                 
  |  ___|   _ _ __   ___| |_(_) ___  _ __  ___ 
@@ -43,6 +98,26 @@ typedef enum {
 
 /* LIFECYCLE ******************************************************************/
 block_t *block_new(char const *line, block_t *prev, machine_t const *machine);
+// Allocates the block within an arena (or on the heap if arena is NULL); 
+// block_free() on such a block only detaches it from the list
+block_t *block_new_in(char const *line, block_t *prev,
+                      machine_t const *machine, arena_t *arena);
+// Same, but the block keeps a view of len chars of src (not NUL-terminated)
+// instead of a copy: src must outlive the block
+block_t *block_new_view(char const *src, size_t len, block_t *prev,
+                        machine_t const *machine, arena_t *arena);
+// The same in three steps, for parallel parsing: block_alloc() creates an
+// unparsed block, block_lex() scans its line (different blocks can be lexed
+// concurrently), block_link() appends it to prev in program order, resolving
+// the modal state and computing geometry and velocity profile
+block_t *block_alloc(char const *src, size_t len, machine_t const *machine,
+                     arena_t *arena);
+ccnc_error_t block_lex(block_t *b);
+ccnc_error_t block_link(block_t *b, block_t *prev);
+// Restores a block saved with block_save(), appending it to prev; base is
+// the G-code text the line view refers to
+block_t *block_load(block_record_t const *rec, char const *base,
+                    block_t *prev, machine_t const *machine, arena_t *arena);
 void block_free(block_t *b);
 void block_print(block_t const *b, FILE *out);
 
@@ -52,19 +127,62 @@ data_t block_length(block_t const *b);
 data_t block_dtheta(block_t const *b);
 block_type_t block_type(block_t const *b);
 data_t block_dt(block_t const *b);
+// The G-code line, copied from the source view on first call
 char *block_line(block_t const *b);
 size_t block_n(block_t const *b);
 data_t block_r(block_t const *b);
 point_t *block_center(block_t const *b);
 point_t *block_target(block_t const *b);
 block_t *block_next(block_t const *b);
+point_t *block_start(block_t const *b);
+data_t block_theta0(block_t const *b);
+block_profile_t const *block_profile(block_t const *b);
+// Fills a record with the block data; base is the start of the G-code text
+void block_save(block_t const *b, char const *base, block_record_t *rec);
 
 
 /* METHODS ********************************************************************/
 data_t block_lambda(block_t *b, data_t time, data_t *speed);
 point_t *block_interpolate(block_t *b, data_t lambda);
+// Interpolates into result instead of the machine setpoint, so that it can
+// run on a thread other than the one publishing the setpoint
+point_t *block_interpolate_to(block_t const *b, data_t lambda, point_t *result);
 point_t *block_interpolate_t(block_t *b, data_t time, data_t *lambda, data_t *speed);
+// Prepares it for walking b in n steps, i.e. n + 1 points from lambda 0 to 1,
+// for offline trajectories and previews. Arcs are stepped by rotating the
+// radius vector, with no cos()/sin() per point: the rotation is resynced to
+// the exact angle every BLOCK_STEP_SYNC steps and at the last point, so the
+// drift never exceeds BLOCK_STEP_SYNC rounding errors (about 1E-13 * r).
+// Rapids are stepped as segments
+void block_step_init(block_step_t *it, block_t const *b, size_t n);
+// Writes the next point into p and returns 1, or returns 0 after the last
+int block_step_next(block_step_t *it, point_t *p);
+void block_lookahead(block_t *b, size_t window);
+// Completes the look-ahead when b is the last block of the program
+void block_lookahead_end(block_t *b, size_t window);
 
-
+// Evaluates lambda and speed (mm/min) of a velocity profile at a given time.
+// Inlined, for it is shared by the block and the compiled program
+// interpolators
+static inline data_t block_poly_lambda(block_poly_t const *poly, data_t t,
+                                       data_t *s) {
+  assert(poly && s);
+  int k;
+  data_t tau;
+  if (t < 0) {
+    *s = poly->v[0][0];
+    return 0.0;
+  } else if (t >= poly->t[7]) {
+    *s = poly->ve;
+    return 1.0;
+  }
+  // zero-length phases are skipped; deceleration starts at t[4]
+  for (k = t < poly->t[4] ? 0 : 4; k < 6 && t >= poly->t[k + 1]; k++)
+    ;
+  tau = t - poly->t[k];
+  *s = poly->v[k][0] + (poly->v[k][1] + poly->v[k][2] * tau) * tau;
+  return poly->c[k][0] +
+         (poly->c[k][1] + (poly->c[k][2] + poly->c[k][3] * tau) * tau) * tau;
+}
 
 #endif // BLOCK_H
\ No newline at end of file
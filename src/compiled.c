@@ -0,0 +1,289 @@
+/*
+   ____                      _ _          _        _
+  / ___|___  _ __ ___  _ __ (_) | ___  __| |   ___| | __ _ ___ ___
+ | |   / _ \| '_ ` _ \| '_ \| | |/ _ \/ _` |  / __| |/ _` / __/ __|
+ | |__| (_) | | | | | | |_) | | |  __/ (_| | | (__| | (_| \__ \__ \
+  \____\___/|_| |_| |_| .__/|_|_|\___|\__,_|  \___|_|\__,_|___/___/
+                      |_|
+* This is the implementation of the Compiled class of C-CNC
+*/
+#include "compiled.h"
+#include <math.h>
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Structure representing the Compiled class: one array per field, so that
+// walking the program only touches the fields actually needed
+typedef struct compiled {
+  size_t n, size;                   // number of blocks and arrays capacity
+  uint8_t *type;                    // block type
+  size_t *num;                      // block number
+  data_t *t0, *dt;                  // start time and duration
+  block_poly_t *poly;               // velocity profile
+  data_t *l;                        // length
+  data_t *x0, *y0, *z0;             // start point
+  data_t *dx, *dy, *dz;             // segment projections
+  data_t *xc, *yc, *r;              // arc center and radius
+  data_t *theta0, *dtheta;          // arc initial angle and angle
+} compiled_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* STATIC FUNCTIONS ***********************************************************/
+static int compiled_grow(compiled_t *c);
+
+/* LIFECYCLE ******************************************************************/
+compiled_t *compiled_new(program_t *program) {
+  assert(program);
+  compiled_t *c = NULL;
+  block_t *b = NULL;
+  block_profile_t const *prof = NULL;
+  point_t *p0, *p1, *pc;
+  size_t i;
+  data_t t0 = 0;
+
+  c = malloc(sizeof(compiled_t));
+  if (!c) {
+    eprintf("Could not allocate memory for compiled program\n");
+    return NULL;
+  }
+  memset(c, 0, sizeof(*c));
+
+  program_reset(program);
+  while ((b = program_next(program))) {
+    if (c->n == c->size && compiled_grow(c)) {
+      eprintf("Could not allocate memory for compiled program\n");
+      program_reset(program);
+      compiled_free(c);
+      return NULL;
+    }
+    i = c->n++;
+    prof = block_profile(b);
+    p0 = block_start(b);
+    p1 = block_target(b);
+    pc = block_center(b);
+    c->type[i] = block_type(b);
+    c->num[i] = block_n(b);
+    c->t0[i] = t0;
+    c->dt[i] = block_dt(b);
+    c->poly[i] = prof->poly;
+    c->l[i] = prof->l;
+    c->x0[i] = point_x(p0);
+    c->y0[i] = point_y(p0);
+    c->z0[i] = point_z(p0);
+    c->dx[i] = point_x(p1) - point_x(p0);
+    c->dy[i] = point_y(p1) - point_y(p0);
+    c->dz[i] = point_z(p1) - point_z(p0);
+    c->xc[i] = point_x(pc);
+    c->yc[i] = point_y(pc);
+    c->r[i] = block_r(b);
+    c->theta0[i] = block_theta0(b);
+    c->dtheta[i] = block_dtheta(b);
+    t0 += c->dt[i];
+  }
+  program_reset(program);
+  return c;
+}
+
+void compiled_free(compiled_t *c) {
+  assert(c);
+  free(c->type);
+  free(c->num);
+  free(c->t0);
+  free(c->dt);
+  free(c->poly);
+  free(c->l);
+  free(c->x0);
+  free(c->y0);
+  free(c->z0);
+  free(c->dx);
+  free(c->dy);
+  free(c->dz);
+  free(c->xc);
+  free(c->yc);
+  free(c->r);
+  free(c->theta0);
+  free(c->dtheta);
+  free(c);
+  c = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+size_t compiled_length(compiled_t const *c) {
+  assert(c);
+  return c->n;
+}
+
+data_t compiled_duration(compiled_t const *c) {
+  assert(c);
+  return c->n ? c->t0[c->n - 1] + c->dt[c->n - 1] : 0.0;
+}
+
+#define compiled_getter(typ, par, name)                                        \
+  typ compiled_##name(compiled_t const *c, size_t i) {                         \
+    assert(c && i < c->n);                                                     \
+    return (typ)c->par[i];                                                     \
+  }
+
+compiled_getter(block_type_t, type, type);
+compiled_getter(size_t, num, n);
+compiled_getter(data_t, dt, dt);
+compiled_getter(data_t, t0, t0);
+
+/* METHODS ********************************************************************/
+size_t compiled_find(compiled_t const *c, data_t time) {
+  assert(c && c->n > 0);
+  size_t lo = 0, hi = c->n - 1, mid;
+  // binary search of the last block starting before time
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (c->t0[mid] <= time)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+data_t compiled_interpolate(compiled_t const *c, size_t i, data_t t,
+                            data_t *speed, point_t *pos) {
+  assert(c && i < c->n && speed && pos);
+  data_t lambda, angle;
+
+  switch (c->type[i]) {
+  case LINE:
+  case RAPID:
+    // also with zero length (e.g. a G00 to the current position), whose
+    // profile lasts one tick at zero speed
+    lambda = block_poly_lambda(&c->poly[i], t, speed);
+    point_set_x(pos, c->x0[i] + c->dx[i] * lambda);
+    point_set_y(pos, c->y0[i] + c->dy[i] * lambda);
+    break;
+  case CWA:
+  case CCWA:
+    lambda = block_poly_lambda(&c->poly[i], t, speed);
+    angle = c->theta0[i] + c->dtheta[i] * lambda;
+    point_set_x(pos, c->xc[i] + c->r[i] * cos(angle));
+    point_set_y(pos, c->yc[i] + c->r[i] * sin(angle));
+    break;
+  default: // no motion
+    lambda = 0.0;
+    *speed = 0.0;
+    point_set_x(pos, c->x0[i]);
+    point_set_y(pos, c->y0[i]);
+    break;
+  }
+  point_set_z(pos, c->z0[i] + c->dz[i] * lambda);
+  return lambda;
+}
+
+/* STATIC FUNCTIONS ***********************************************************/
+
+// Doubles the capacity of all the arrays
+static int compiled_grow(compiled_t *c) {
+  size_t size = c->size ? c->size * 2 : 1024;
+  void *ptr = NULL;
+
+#define GROW(field)                                                            \
+  ptr = realloc(c->field, size * sizeof(*c->field));                           \
+  if (!ptr)                                                                    \
+    return 1;                                                                  \
+  c->field = ptr;
+
+  GROW(type);
+  GROW(num);
+  GROW(t0);
+  GROW(dt);
+  GROW(poly);
+  GROW(l);
+  GROW(x0);
+  GROW(y0);
+  GROW(z0);
+  GROW(dx);
+  GROW(dy);
+  GROW(dz);
+  GROW(xc);
+  GROW(yc);
+  GROW(r);
+  GROW(theta0);
+  GROW(dtheta);
+#undef GROW
+
+  c->size = size;
+  return 0;
+}
+
+/*
+   ____                      _ _          _   _            _
+  / ___|___  _ __ ___  _ __ (_) | ___  __| | | |_ ___  ___| |_
+ | |   / _ \| '_ ` _ \| '_ \| | |/ _ \/ _` | | __/ _ \/ __| __|
+ | |__| (_) | | | | | | |_) | | |  __/ (_| | | ||  __/\__ \ |_
+  \____\___/|_| |_| |_| .__/|_|_|\___|\__,_|  \__\___||___/\__|
+                      |_|
+*/
+
+#ifdef COMPILED_MAIN
+// Compares the compiled program interpolation with the blocks one
+int main(int argc, char const **argv) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  compiled_t *c = NULL;
+  block_t *b = NULL;
+  point_t pos, *sp = NULL;
+  data_t t, tq, lambda, l, v, s, err = 0;
+  size_t i;
+
+  if (argc != 3) {
+    eprintf("I need exactly two arguments: G-code file, and INI file\n");
+    exit(EXIT_FAILURE);
+  }
+  m = machine_new(argv[2]);
+  p = program_new(argv[1]);
+  if (!m || !p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    exit(EXIT_FAILURE);
+  }
+  c = compiled_new(p);
+  if (!c) {
+    exit(EXIT_FAILURE);
+  }
+  printf("Compiled %zu blocks, duration %.3f s\n", compiled_length(c),
+         compiled_duration(c));
+
+  tq = machine_tq(m);
+  for (i = 0; (b = program_next(p)); i++) {
+    assert(compiled_n(c, i) == block_n(b));
+    if (block_type(b) != RAPID && block_type(b) != LINE &&
+        block_type(b) != CWA && block_type(b) != CCWA)
+      continue;
+    assert(compiled_find(c, compiled_t0(c, i) + compiled_dt(c, i) / 2) == i);
+    for (t = 0; t - compiled_dt(c, i) < tq / 10.0; t += tq) {
+      sp = block_interpolate_t(b, t, &lambda, &v);
+      l = compiled_interpolate(c, i, t, &s, &pos);
+      err = fmax(err, fabs(lambda - l) + fabs(v - s));
+      err = fmax(err, point_dist(sp, &pos));
+    }
+  }
+  printf("Max difference w.r.t. block interpolation: %g\n", err);
+
+  compiled_free(c);
+  program_free(p);
+  machine_free(m);
+  return err == 0 ? 0 : EXIT_FAILURE;
+}
+
+#endif // COMPILED_MAIN
@@ -0,0 +1,66 @@
+/*
+   ____                      _ _          _        _
+  / ___|___  _ __ ___  _ __ (_) | ___  __| |   ___| | __ _ ___ ___
+ | |   / _ \| '_ ` _ \| '_ \| | |/ _ \/ _` |  / __| |/ _` / __/ __|
+ | |__| (_) | | | | | | |_) | | |  __/ (_| | | (__| | (_| \__ \__ \
+  \____\___/|_| |_| |_| .__/|_|_|\___|\__,_|  \___|_|\__,_|___/___/
+                      |_|
+* Compiled program: planned blocks stored as a structure of arrays, for
+* offline trajectory generation (simulation, cycle time estimation)
+*/
+#ifndef COMPILED_H
+#define COMPILED_H
+
+#include "defines.h"
+#include "point.h"
+#include "block.h"
+#include "program.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Compiled class
+typedef struct compiled compiled_t;
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// Compiles a parsed program (the program is reset before and after)
+compiled_t *compiled_new(program_t *program);
+void compiled_free(compiled_t *c);
+
+
+/* ACCESSORS ******************************************************************/
+size_t compiled_length(compiled_t const *c);
+data_t compiled_duration(compiled_t const *c);
+block_type_t compiled_type(compiled_t const *c, size_t i);
+size_t compiled_n(compiled_t const *c, size_t i);
+data_t compiled_dt(compiled_t const *c, size_t i);
+// Start time of block i
+data_t compiled_t0(compiled_t const *c, size_t i);
+
+
+/* METHODS ********************************************************************/
+// Index of the block being executed at the given program time
+size_t compiled_find(compiled_t const *c, data_t time);
+// Interpolates block i at block time t: fills pos and speed (mm/min),
+// returns lambda
+data_t compiled_interpolate(compiled_t const *c, size_t i, data_t t,
+                            data_t *speed, point_t *pos);
+
+
+#endif // COMPILED_H
@@ -8,7 +8,7 @@ gv_fsm version 0.3.4
 Generation date: 2024-05-09 11:59:47 +0200
 Generated from: src/fsm.dot
 The finite state machine has:
-  8 states
+  7 states
   7 transition functions
 Functions and types have been generated with prefix "ccnc_"
 ******************************************************************************/
@@ -18,6 +18,7 @@ Functions and types have been generated with prefix "ccnc_"
 #include <unistd.h>
 #include <math.h>
 #include <sys/param.h>
+#include <time.h>
 #include "fsm.h"
 #include "block.h"
 #include "point.h"
@@ -47,9 +48,108 @@ static char read_key() {
   return key;
 }
 
+// One consistent feedback snapshot per tick; its age (time since it was
+// received) is collected in the feedback_age histogram, if any
+static void read_feedback(ccnc_state_data_t *data, machine_feedback_t *fb) {
+  struct timespec now;
+  machine_feedback(data->machine, fb);
+  if (data->feedback_age && fb->seq > 0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency_record(data->feedback_age,
+                   now.tv_sec * 1000000000LL + now.tv_nsec - fb->timestamp);
+  }
+}
+
+// Opens the block of sp, its first setpoint, in the trajectory table
+static void log_block(ccnc_state_data_t *data, setpoint_t const *sp) {
+  logger_push(data->logger, &(logger_record_t){.kind = LOGGER_BLOCK,
+                                               .type = sp->type,
+                                               .n = sp->n,
+                                               .s = sp->length});
+}
+
+// The next setpoint to execute, left where it is: the batch already
+// published comes first, then the trajectory queue. Returns NULL when the
+// producer is late, counted as an underrun only if count is set
+static setpoint_t const *peek_setpoint(ccnc_state_data_t *data, int count) {
+  if (data->batch_pos < data->batch_len)
+    return &data->batch[data->batch_pos];
+  return count ? trajectory_peek(data->trajectory)
+               : trajectory_head(data->trajectory);
+}
+
+// Copies the next setpoint into sp; returns 0, leaving sp unchanged, when
+// the producer is late
+static int pop_setpoint(ccnc_state_data_t *data, setpoint_t *sp) {
+  if (data->batch_pos < data->batch_len) {
+    *sp = data->batch[data->batch_pos++];
+    return 1;
+  }
+  return trajectory_pop(data->trajectory, sp);
+}
+
+// The first setpoint of the next block with motion (or the END one), left
+// in place. Blocks without motion on the way are logged and consumed here,
+// so that they take no tick. Returns NULL when the producer is late, counted
+// as an underrun only if count is set
+static setpoint_t const *next_block(ccnc_state_data_t *data, int count) {
+  setpoint_t const *sp = NULL;
+  setpoint_t skip;
+  while ((sp = peek_setpoint(data, count)) && !(sp->flags & SETPOINT_END) &&
+         sp->type == NO_MOTION) {
+    log_block(data, sp);
+    pop_setpoint(data, &skip);
+  }
+  return sp;
+}
+
+// Publishes the next [MQTT]:batch setpoints in a single message, while the
+// previous batch is still being executed, so that the machine always holds
+// setpoints ahead: each one is due a sampling time after the previous one,
+// the first of those already published being due now. Batches go on across
+// consecutive interpolated blocks, and stop at the end of rapids
+static ccnc_error_t publish_batch(ccnc_state_data_t *data) {
+  machine_t *m = data->machine;
+  setpoint_t const *sp = NULL;
+  point_t p;
+  size_t i, n, ahead = 0;
+  // the setpoints not yet executed are moved to the front of the buffer
+  data->batch_len -= data->batch_pos;
+  memmove(data->batch, data->batch + data->batch_pos,
+          data->batch_len * sizeof(setpoint_t));
+  data->batch_pos = 0;
+  for (i = 0; i < data->batch_len; i++)
+    ahead += data->batch[i].type != NO_MOTION;
+  n = trajectory_pop_block(data->trajectory, data->batch + data->batch_len,
+                           machine_batch(m),
+                           data->batch_len ? &data->batch[data->batch_len - 1]
+                                           : NULL);
+  for (i = data->batch_len; i < data->batch_len + n; i++) {
+    sp = &data->batch[i];
+    if (sp->type == NO_MOTION) // only logged
+      continue;
+    point_set_xyz(&p, sp->x, sp->y, sp->z);
+    if (machine_batch_push(m, &p, ahead++ * machine_tq(m),
+                           sp->type == RAPID) != NO_ERR)
+      return MQTT_ERR;
+  }
+  data->batch_len += n;
+  return machine_batch_flush(m);
+}
+
+// Moves on to the next setpoint of the current block; if the producer is
+// late, the previous one is repeated. With [MQTT]:batch > 1, a new batch is
+// published as soon as the previous one starts being executed
+static void next_setpoint(ccnc_state_data_t *data) {
+  if (data->batch &&
+      data->batch_len - data->batch_pos <= (size_t)machine_batch(data->machine))
+    publish_batch(data);
+  pop_setpoint(data, &data->sp);
+}
+
 // GLOBALS
 // State human-readable names
-const char *ccnc_state_names[] = {"init", "idle", "stop", "load_block", "go_to_zero", "no_motion", "rapid_motion", "interp_motion"};
+const char *ccnc_state_names[] = {"init", "idle", "stop", "load_block", "go_to_zero", "rapid_motion", "interp_motion"};
 
 // List of state functions
 state_func_t *const ccnc_state_table[CCNC_NUM_STATES] = {
@@ -58,22 +158,20 @@ state_func_t *const ccnc_state_table[CCNC_NUM_STATES] = {
   ccnc_do_stop,          // in state stop
   ccnc_do_load_block,    // in state load_block
   ccnc_do_go_to_zero,    // in state go_to_zero
-  ccnc_do_no_motion,     // in state no_motion
   ccnc_do_rapid_motion,  // in state rapid_motion
   ccnc_do_interp_motion, // in state interp_motion
 };
 
 // Table of transition functions
 transition_func_t *const ccnc_transition_table[CCNC_NUM_STATES][CCNC_NUM_STATES] = {
-  /* states:           init             , idle             , stop             , load_block       , go_to_zero       , no_motion        , rapid_motion     , interp_motion     */
-  /* init          */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
-  /* idle          */ {NULL             , NULL             , NULL             , ccnc_reset       , ccnc_begin_zero  , NULL             , NULL             , NULL             }, 
-  /* stop          */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
-  /* load_block    */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , ccnc_begin_rapid , ccnc_begin_interp}, 
-  /* go_to_zero    */ {NULL             , ccnc_end_zero    , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
-  /* no_motion     */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
-  /* rapid_motion  */ {NULL             , NULL             , NULL             , ccnc_end_rapid   , NULL             , NULL             , NULL             , NULL             }, 
-  /* interp_motion */ {NULL             , NULL             , NULL             , ccnc_end_interp  , NULL             , NULL             , NULL             , NULL             }, 
+  /* states:           init             , idle             , stop             , load_block       , go_to_zero       , rapid_motion     , interp_motion     */
+  /* init          */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
+  /* idle          */ {NULL             , NULL             , NULL             , ccnc_reset       , ccnc_begin_zero  , NULL             , NULL             }, 
+  /* stop          */ {NULL             , NULL             , NULL             , NULL             , NULL             , NULL             , NULL             }, 
+  /* load_block    */ {NULL             , NULL             , NULL             , NULL             , NULL             , ccnc_begin_rapid , ccnc_begin_interp}, 
+  /* go_to_zero    */ {NULL             , ccnc_end_zero    , NULL             , NULL             , NULL             , NULL             , NULL             }, 
+  /* rapid_motion  */ {NULL             , NULL             , NULL             , ccnc_end_rapid   , NULL             , NULL             , NULL             }, 
+  /* interp_motion */ {NULL             , NULL             , NULL             , ccnc_end_interp  , NULL             , NULL             , NULL             }, 
 };
 
 /*  ____  _        _       
@@ -114,6 +212,11 @@ ccnc_state_t ccnc_do_init(ccnc_state_data_t *data) {
     next_state = CCNC_STATE_STOP;
     goto next_state;
   }
+  data->logger = logger_new(data->machine, stdout);
+  if (!data->logger) {
+    next_state = CCNC_STATE_STOP;
+    goto next_state;
+  }
 
   // 3. load and parse G-Code file
   data->program = program_new(data->prog_file);
@@ -121,10 +224,25 @@ ccnc_state_t ccnc_do_init(ccnc_state_data_t *data) {
     next_state = CCNC_STATE_STOP;
     goto next_state;
   }
-  if (program_parse(data->program, data->machine) != NO_ERR) {
+  if ((data->error = program_parse(data->program, data->machine)) != NO_ERR) {
     next_state = CCNC_STATE_STOP;
     goto next_state;
   }
+  data->trajectory = trajectory_new(data->program, data->machine);
+  if (!data->trajectory) {
+    next_state = CCNC_STATE_STOP;
+    goto next_state;
+  }
+  if (machine_batch(data->machine) > 1) {
+    // the batch being executed, and the next one
+    data->batch =
+        malloc(2 * machine_batch(data->machine) * sizeof(setpoint_t));
+    if (!data->batch) {
+      eprintf("Could not allocate memory for setpoint batches\n");
+      next_state = CCNC_STATE_STOP;
+      goto next_state;
+    }
+  }
 
   // 4. print parsed program
   fprintf(stderr, "Current program: %s\n", data->prog_file);
@@ -155,13 +273,16 @@ ccnc_state_t ccnc_do_init(ccnc_state_data_t *data) {
 // SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_idle(ccnc_state_data_t *data) {
   ccnc_state_t next_state = CCNC_NO_CHANGE;
-  char key;
+  char key = 0;
 
   // Steps:
-  // 1. Wait for key press
+  // 1. Wait for key press, once the log is written (unless already quitting)
   syslog(LOG_INFO, "[FSM] In state idle");
-  fprintf(stderr, "Press <spacebar> to run, 'z' to zero, 'q' to quit\n");
-  key = read_key();
+  logger_flush(data->logger);
+  if (!_exit_request) {
+    fprintf(stderr, "Press <spacebar> to run, 'z' to zero, 'q' to quit\n");
+    key = read_key();
+  }
 
   switch(key) {
   case ' ':
@@ -221,6 +342,9 @@ ccnc_state_t ccnc_do_stop(ccnc_state_data_t *data) {
 
   // 3. clean up resources
   iprintf("Cleaning up...\n");
+  if (data->trajectory) trajectory_free(data->trajectory);
+  free(data->batch);
+  if (data->logger) logger_free(data->logger);
   if (data->program) program_free(data->program);
   if (data->machine) machine_free(data->machine);
   iprintf("done.\n");
@@ -239,28 +363,51 @@ ccnc_state_t ccnc_do_stop(ccnc_state_data_t *data) {
 
 
 // Function to be executed in state load_block
-// valid return states: CCNC_STATE_IDLE, CCNC_STATE_NO_MOTION, CCNC_STATE_RAPID_MOTION, CCNC_STATE_INTERP_MOTION
+// valid return states: CCNC_NO_CHANGE, CCNC_STATE_IDLE, CCNC_STATE_LOAD_BLOCK, CCNC_STATE_RAPID_MOTION, CCNC_STATE_INTERP_MOTION
+// SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_load_block(ccnc_state_data_t *data) {
   ccnc_state_t next_state = CCNC_STATE_IDLE;
-  block_t *b = NULL;
+  setpoint_t const *sp = NULL;
 
-  syslog(LOG_INFO, "[FSM] In state load_block");
-  
   // Steps:
-  // 1. get and print next block:
-  b = program_next(data->program);
-  if (!b) { // reached the end of program
+  // 1. get and log the first setpoint of the next block (blocks are
+  // walked by the trajectory producer thread, ahead of time). Consecutive
+  // interpolated blocks are chained by interp_motion and do not pass from
+  // here; blocks without motion are consumed on the way, taking no tick.
+  // The tick is never held waiting for the producer: while it fills the
+  // queue after the start, or if it is late, the motion stays at rest and
+  // this is tried again on the next tick
+  if (!trajectory_ready(data->trajectory) || !(sp = next_block(data, 1))) {
+    next_state = CCNC_NO_CHANGE;
+    goto next_state;
+  }
+  if (sp->flags & SETPOINT_END) { // reached the end of program
+    if (trajectory_underruns(data->trajectory) > 0) {
+      wprintf("Setpoints were late %zu times\n",
+              trajectory_underruns(data->trajectory));
+      syslog(LOG_WARNING, "[FSM] Setpoints were late %zu times",
+             trajectory_underruns(data->trajectory));
+    }
+    trajectory_stop(data->trajectory);
+    // a streamed program with a parsing error is not over: quit as when
+    // the whole program is parsed in init
+    if (sp && sp->flags & SETPOINT_ERROR) {
+      eprintf("Program aborted at a parsing error\n");
+      syslog(LOG_ERR, "[FSM] Program aborted at a parsing error");
+      data->error = program_error(data->program);
+      _exit_request = 1;
+    }
     next_state = CCNC_STATE_IDLE;
     goto next_state;
   }
-  block_print(b, stderr);
+  data->sp = *sp;
+  log_block(data, sp);
 
-  // 2. depending on block type, select the next state
-  switch (block_type(b)) {
-  case NO_MOTION:
-    next_state = CCNC_STATE_NO_MOTION;
-    break;
+  // 2. depending on block type, select the next state; interpolated blocks
+  // and rapids pop their setpoints in interp_motion and rapid_motion
+  switch (sp->type) {
   case RAPID:
+    data->sp.flags = 0; // not executed yet, even if it is the last one
     next_state = CCNC_STATE_RAPID_MOTION;
     break;
   case LINE:
@@ -278,8 +425,9 @@ ccnc_state_t ccnc_do_load_block(ccnc_state_data_t *data) {
   
 next_state:
   switch (next_state) {
+    case CCNC_NO_CHANGE:
     case CCNC_STATE_IDLE:
-    case CCNC_STATE_NO_MOTION:
+    case CCNC_STATE_LOAD_BLOCK:
     case CCNC_STATE_RAPID_MOTION:
     case CCNC_STATE_INTERP_MOTION:
       break;
@@ -288,6 +436,9 @@ next_state:
       next_state = CCNC_NO_CHANGE;
   }
   
+  // SIGINT transition override
+  if (_exit_request) next_state = CCNC_STATE_STOP;
+  
   return next_state;
 }
 
@@ -297,6 +448,7 @@ next_state:
 // SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_go_to_zero(ccnc_state_data_t *data) {
   ccnc_state_t next_state = CCNC_NO_CHANGE;
+  machine_feedback_t fb;
   
   syslog(LOG_INFO, "[FSM] In state go_to_zero");
 
@@ -307,7 +459,8 @@ ccnc_state_t ccnc_do_go_to_zero(ccnc_state_data_t *data) {
   }
 
   // 2. go back to idle if setpoint has been reached
-  if (machine_error(data->machine) < machine_max_error(data->machine)) {
+  read_feedback(data, &fb);
+  if (fb.error < machine_max_error(data->machine)) {
     next_state = CCNC_STATE_IDLE;
   }
 
@@ -334,71 +487,55 @@ ccnc_state_t ccnc_do_go_to_zero(ccnc_state_data_t *data) {
 }
 
 
-// Function to be executed in state no_motion
-// valid return states: CCNC_STATE_LOAD_BLOCK
-ccnc_state_t ccnc_do_no_motion(ccnc_state_data_t *data) {
-  ccnc_state_t next_state = CCNC_STATE_LOAD_BLOCK;
-  
-  syslog(LOG_INFO, "[FSM] In state no_motion");
-
-  // Steps:
-  // 1. print block number
-  fprintf(stderr, "No motion block %zu\n", block_n(program_current(data->program)));
-
-  // 2. increment total time
-  data->t_tot += machine_tq(data->machine);
-  
-  switch (next_state) {
-    case CCNC_STATE_LOAD_BLOCK:
-      break;
-    default:
-      syslog(LOG_WARNING, "[FSM] Cannot pass from no_motion to %s, remaining in this state", ccnc_state_names[next_state]);
-      next_state = CCNC_NO_CHANGE;
-  }
-  
-  return next_state;
-}
-
-
 // Function to be executed in state rapid_motion
 // valid return states: CCNC_NO_CHANGE, CCNC_STATE_LOAD_BLOCK, CCNC_STATE_RAPID_MOTION
 // SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_rapid_motion(ccnc_state_data_t *data) {
   ccnc_state_t next_state = CCNC_NO_CHANGE;
-  block_t *b = program_current(data->program);
-  point_t *pos = machine_position(data->machine);
-  data_t duration = 0.0;
-  data_t rel_distance = 0.0;
-
-  // syslog(LOG_INFO, "[FSM] In state rapid_motion");
+  setpoint_t const *sp = &data->sp;
+  machine_feedback_t fb;
 
   // Steps:
-  // 1. synch the machine
-  machine_sync(data->machine, 1);
-
-  // 2. exit state if error is small
-  duration = block_length(b) / machine_fmax(data->machine) * 60.0;
-  if (machine_error(data->machine) < machine_max_error(data->machine) && data->t_blk > duration) {
-    next_state = CCNC_STATE_LOAD_BLOCK;
-  }
-
-  // 3. CTLR-C
+  // 1. rapids are planned at fmax and interpolated like G01 blocks: get the
+  // next setpoint, and hold the last one until the machine is in position.
+  // CTRL-C skips to the end of the block, with no in-position check (over
+  // more ticks, if the producer has not queued it yet)
   if (_exit_request) {
     _exit_request = 0;
-    next_state = CCNC_STATE_LOAD_BLOCK;
-  } 
+    data->skip = 1;
+  }
+  if (data->skip) {
+    while (!(sp->flags & SETPOINT_LAST) && pop_setpoint(data, &data->sp))
+      continue;
+    if (sp->flags & SETPOINT_LAST) {
+      data->skip = 0;
+      next_state = CCNC_STATE_LOAD_BLOCK;
+    }
+  } else if (!(sp->flags & SETPOINT_LAST)) {
+    next_setpoint(data);
+  }
+  point_set_xyz(machine_setpoint(data->machine), sp->x, sp->y, sp->z);
 
-  // 4. print position table
-  rel_distance = MIN(machine_error(data->machine) / block_length(b), 1);
-  printf("%03lu %02d %.3f %.3f %.3f %.3f %.1f %.3f %.3f %.3f\n", block_n(b), block_type(b), data->t_tot, data->t_blk, rel_distance, rel_distance*block_length(b), machine_fmax(data->machine), point_x(pos), point_y(pos), point_z(pos));
+  // 2. sync the machine (batches are published in step 1)
+  if (!data->batch || data->skip || next_state == CCNC_STATE_LOAD_BLOCK)
+    machine_sync(data->machine, 1);
+
+  // 3. feedback is only used as an in-position check at the end
+  if (sp->flags & SETPOINT_LAST) {
+    read_feedback(data, &fb);
+    if (fb.error < machine_max_error(data->machine))
+      next_state = CCNC_STATE_LOAD_BLOCK;
+  }
+
+  // 4. log position table row (progress is shown by the log writer)
+  logger_push(data->logger, &(logger_record_t){
+      .kind = LOGGER_ROW, .type = sp->type, .n = sp->n, .t_tot = data->t_tot,
+      .t_blk = sp->t_blk, .lambda = sp->lambda, .s = sp->lambda * sp->length,
+      .feedrate = sp->feedrate, .x = sp->x, .y = sp->y, .z = sp->z});
 
   // 5. increment times
   data->t_blk += machine_tq(data->machine);
   data->t_tot += machine_tq(data->machine);
-
-  // 6. print status
-  fprintf(stderr, "\r[%5.1f%%]", fabs(1.0 - rel_distance) * 100);
-  fflush(stderr);
   
   switch (next_state) {
     case CCNC_NO_CHANGE:
@@ -422,34 +559,41 @@ ccnc_state_t ccnc_do_rapid_motion(ccnc_state_data_t *data) {
 // SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_interp_motion(ccnc_state_data_t *data) {
   ccnc_state_t next_state = CCNC_NO_CHANGE;
-  data_t lambda, feedrate;
-  point_t *sp = NULL;
-  block_t *b = program_current(data->program);
-
-  // syslog(LOG_INFO, "[FSM] In state interp_motion");
+  setpoint_t const *sp = &data->sp;
+  setpoint_t const *next = NULL;
 
   // Steps:
-  // 1. calculate lambda and intepolate
-  sp = block_interpolate_t(b, data->t_blk, &lambda, &feedrate);
-
-  // 2. print position table
-  printf("%03lu %02d %.3f %.3f %.3f %.3f %.1f %.3f %.3f %.3f\n", block_n(b), block_type(b), data->t_tot, data->t_blk, lambda, lambda * block_length(b), feedrate, point_x(sp), point_y(sp), point_z(sp));
-
-  // 3. Sync machine
-  machine_sync(data->machine, 0);
-
-  // 4. check if block is done
-  if (data->t_blk >= block_dt(b) + machine_tq(data->machine) / 10.0) {
-    next_state = CCNC_STATE_LOAD_BLOCK;
+  // 1. get the next interpolated setpoint
+  next_setpoint(data);
+  point_set_xyz(machine_setpoint(data->machine), sp->x, sp->y, sp->z);
+
+  // 2. log position table row (progress is shown by the log writer)
+  logger_push(data->logger, &(logger_record_t){
+      .kind = LOGGER_ROW, .type = sp->type, .n = sp->n, .t_tot = data->t_tot,
+      .t_blk = sp->t_blk, .lambda = sp->lambda, .s = sp->lambda * sp->length,
+      .feedrate = sp->feedrate, .x = sp->x, .y = sp->y, .z = sp->z});
+
+  // 3. Sync machine (batches are published in step 1)
+  if (!data->batch)
+    machine_sync(data->machine, 0);
+
+  // 4. check if block is done: if the next block is interpolated too (and
+  // already queued), chain to it within this tick, so that its first
+  // setpoint is executed on the next one, with no idle tick in between
+  if (sp->flags & SETPOINT_LAST) {
+    next = next_block(data, 0);
+    if (next && !(next->flags & SETPOINT_END) &&
+        (next->type == LINE || next->type == CWA || next->type == CCWA)) {
+      log_block(data, next);
+      data->t_blk = -machine_tq(data->machine);
+    } else {
+      next_state = CCNC_STATE_LOAD_BLOCK;
+    }
   }
 
-  // 6. increment times
+  // 5. increment times
   data->t_blk += machine_tq(data->machine);
   data->t_tot += machine_tq(data->machine);
-
-  // 7. update status
-  fprintf(stderr, "\r[%5.1f%%]", lambda * 100);
-  fflush(stderr);
   
   switch (next_state) {
     case CCNC_NO_CHANGE:
@@ -484,9 +628,18 @@ ccnc_state_t ccnc_do_interp_motion(ccnc_state_data_t *data) {
 // This function is called in 1 transition:
 // 1. from idle to load_block
 void ccnc_reset(ccnc_state_data_t *data) {
+  ccnc_error_t err = NO_ERR;
   syslog(LOG_INFO, "[FSM] State transition ccnc_reset");
   data->t_blk = data->t_tot = 0.0;
-  printf("#n type t_tot t_blk lambda s feedrate x y z\n");
+  data->batch_len = data->batch_pos = 0;
+  data->skip = 0;
+  // a failure is handled by load_block, as a SIGINT
+  if ((err = trajectory_start(data->trajectory)) != NO_ERR) {
+    syslog(LOG_ERR, "[FSM] Could not start the trajectory");
+    data->error = err;
+    _exit_request = 1;
+  }
+  logger_push(data->logger, &(logger_record_t){.kind = LOGGER_HEADER});
 }
 
 // This function is called in 1 transition:
@@ -507,43 +660,25 @@ void ccnc_begin_zero(ccnc_state_data_t *data) {
 // This function is called in 1 transition:
 // 1. from load_block to rapid_motion
 void ccnc_begin_rapid(ccnc_state_data_t *data) {
-  point_t *sp = machine_setpoint(data->machine);
-  block_t *b = program_current(data->program);
-  point_t *target = block_target(b);
-  syslog(LOG_INFO, "[FSM] State transition ccnc_begin_rapid");
-
   data->t_blk = 0.0;
   machine_listen_start(data->machine);
-  point_set_xyz(sp, point_x(target), point_y(target), point_z(target));
-  machine_sync(data->machine, 1);
-  fprintf(stderr, "[  0.0%%]");
-  fflush(stderr);
 }
 
 // This function is called in 1 transition:
 // 1. from load_block to interp_motion
 void ccnc_begin_interp(ccnc_state_data_t *data) {
-  syslog(LOG_INFO, "[FSM] State transition ccnc_begin_interp");
   data->t_blk = 0.0;
-  fprintf(stderr, "[  0.0%%]");
-  fflush(stderr);
 }
 
 // This function is called in 1 transition:
 // 1. from rapid_motion to load_block
 void ccnc_end_rapid(ccnc_state_data_t *data) {
-  syslog(LOG_INFO, "[FSM] State transition ccnc_end_rapid");
   machine_listen_stop(data->machine);
-  fprintf(stderr, "\b\b\b\b\b\b\b\b");
-  fflush(stderr);
 }
 
 // This function is called in 1 transition:
 // 1. from interp_motion to load_block
 void ccnc_end_interp(ccnc_state_data_t *data) {
-  syslog(LOG_INFO, "[FSM] State transition ccnc_end_interp");
-  fprintf(stderr, "\b\b\b\b\b\b\b\b");
-  fflush(stderr);
 }
 
 // This function is called in 1 transition:
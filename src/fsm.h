@@ -8,7 +8,7 @@ gv_fsm version 0.3.4
 Generation date: 2024-05-09 11:59:47 +0200
 Generated from: src/fsm.dot
 The finite state machine has:
-  8 states
+  7 states
   7 transition functions
 Functions and types have been generated with prefix "ccnc_"
 ******************************************************************************/
@@ -18,6 +18,9 @@ Functions and types have been generated with prefix "ccnc_"
 #include <stdlib.h>
 #include "machine.h"
 #include "program.h"
+#include "trajectory.h"
+#include "logger.h"
+#include "latency.h"
 
 // State data object
 // By default set to void; override this typedef or load the proper
@@ -27,8 +30,16 @@ typedef struct {
   char *prog_file;
   machine_t *machine;
   program_t *program;
+  trajectory_t *trajectory; // setpoints interpolated ahead of time
+  setpoint_t sp; // setpoint being executed
+  setpoint_t *batch; // setpoints published ahead ([MQTT]:batch > 1)
+  size_t batch_len, batch_pos; // setpoints in batch, next one to execute
+  logger_t *logger; // trajectory table and progress writer
+  latency_t *feedback_age; // age of the feedback read by the loop (or NULL)
   data_t t_tot; // total time elapsed since start of program execution
   data_t t_blk; // time elapsed since beginning of current block
+  int skip; // CTRL-C during a rapid: skipping to its end
+  ccnc_error_t error; // program failure, making the exit status non-zero
 } ccnc_state_data_t;
 
 // NOTHING SHALL BE CHANGED AFTER THIS LINE!
@@ -40,7 +51,6 @@ typedef enum {
   CCNC_STATE_STOP,  
   CCNC_STATE_LOAD_BLOCK,  
   CCNC_STATE_GO_TO_ZERO,  
-  CCNC_STATE_NO_MOTION,  
   CCNC_STATE_RAPID_MOTION,  
   CCNC_STATE_INTERP_MOTION,  
   CCNC_NUM_STATES,
@@ -69,17 +79,14 @@ ccnc_state_t ccnc_do_idle(ccnc_state_data_t *data);
 ccnc_state_t ccnc_do_stop(ccnc_state_data_t *data);
 
 // Function to be executed in state load_block
-// valid return states: CCNC_STATE_IDLE, CCNC_STATE_NO_MOTION, CCNC_STATE_RAPID_MOTION, CCNC_STATE_INTERP_MOTION
+// valid return states: CCNC_NO_CHANGE, CCNC_STATE_IDLE, CCNC_STATE_LOAD_BLOCK, CCNC_STATE_RAPID_MOTION, CCNC_STATE_INTERP_MOTION
+// SIGINT triggers an emergency transition to stop
 ccnc_state_t ccnc_do_load_block(ccnc_state_data_t *data);
 
 // Function to be executed in state go_to_zero
 // valid return states: CCNC_NO_CHANGE, CCNC_STATE_IDLE, CCNC_STATE_GO_TO_ZERO
 ccnc_state_t ccnc_do_go_to_zero(ccnc_state_data_t *data);
 
-// Function to be executed in state no_motion
-// valid return states: CCNC_STATE_LOAD_BLOCK
-ccnc_state_t ccnc_do_no_motion(ccnc_state_data_t *data);
-
 // Function to be executed in state rapid_motion
 // valid return states: CCNC_NO_CHANGE, CCNC_STATE_LOAD_BLOCK, CCNC_STATE_RAPID_MOTION
 ccnc_state_t ccnc_do_rapid_motion(ccnc_state_data_t *data);
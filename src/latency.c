@@ -0,0 +1,241 @@
+/*
+ _          _                               _
+| |    __ _| |_ ___ _ __   ___ _   _    ___| | __ _ ___ ___
+| |   / _` | __/ _ \ '_ \ / __| | | |  / __| |/ _` / __/ __|
+| |__| (_| | ||  __/ | | | (__| |_| | | (__| | (_| \__ \__ \
+|_____\__,_|\__\___|_| |_|\___|\__, |  \___|_|\__,_|___/___/
+                               |___/
+
+* This is the implementation of the Latency class of C-CNC
+*/
+#include "latency.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Each power of two is split in 2^LATENCY_SUB_BITS linear sub-buckets, so
+// that the relative error of any value is below 2^-LATENCY_SUB_BITS
+#define LATENCY_SUB_BITS 5
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB)
+
+// Structure representing the Latency class
+typedef struct latency {
+  char name[16];                             // label for printing
+  _Atomic uint64_t count;                    // number of samples
+  _Atomic uint64_t sum;                      // sum of samples (ns)
+  _Atomic uint64_t max;                      // largest sample (ns)
+  _Atomic uint64_t buckets[LATENCY_BUCKETS]; // sample counts
+} latency_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* STATIC FUNCTIONS ***********************************************************/
+static size_t bucket_index(uint64_t v);
+static uint64_t bucket_low(size_t i);
+static uint64_t bucket_width(size_t i);
+
+/* LIFECYCLE ******************************************************************/
+latency_t *latency_new(char const *name) {
+  latency_t *l = calloc(1, sizeof(latency_t));
+  if (!l) {
+    eprintf("Error allocating memory for a latency histogram\n");
+    return NULL;
+  }
+  strncpy(l->name, name ? name : "", sizeof(l->name) - 1);
+  return l;
+}
+
+void latency_free(latency_t *l) {
+  assert(l);
+  free(l);
+  l = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+char const *latency_name(latency_t const *l) {
+  assert(l);
+  return l->name;
+}
+
+uint64_t latency_count(latency_t const *l) {
+  assert(l);
+  return atomic_load_explicit(&l->count, memory_order_relaxed);
+}
+
+uint64_t latency_max(latency_t const *l) {
+  assert(l);
+  return atomic_load_explicit(&l->max, memory_order_relaxed);
+}
+
+data_t latency_mean(latency_t const *l) {
+  assert(l);
+  uint64_t n = latency_count(l);
+  if (n == 0)
+    return 0;
+  return atomic_load_explicit(&l->sum, memory_order_relaxed) / (data_t)n;
+}
+
+// Computed from the bucket midpoints, as the samples are not stored
+data_t latency_sd(latency_t const *l) {
+  assert(l);
+  size_t i;
+  uint64_t c, n = 0;
+  data_t mean = latency_mean(l), d, sum = 0;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    c = atomic_load_explicit(&l->buckets[i], memory_order_relaxed);
+    if (c == 0)
+      continue;
+    d = bucket_low(i) + (bucket_width(i) - 1) / 2.0 - mean;
+    sum += c * d * d;
+    n += c;
+  }
+  return n > 1 ? sqrt(sum / (n - 1)) : 0;
+}
+
+// Returns the highest value equivalent to the bucket that holds the
+// percentile, capped to the actual maximum
+data_t latency_percentile(latency_t const *l, data_t p) {
+  assert(l);
+  size_t i;
+  uint64_t n = latency_count(l), acc = 0, target, top;
+  uint64_t max = latency_max(l);
+  if (n == 0)
+    return 0;
+  if (p >= 1)
+    return max;
+  target = (uint64_t)ceil(p * n);
+  if (target == 0)
+    target = 1;
+  for (i = 0; i < LATENCY_BUCKETS; i++) {
+    acc += atomic_load_explicit(&l->buckets[i], memory_order_relaxed);
+    if (acc >= target) {
+      top = bucket_low(i) + bucket_width(i) - 1;
+      return top < max ? top : max;
+    }
+  }
+  return max;
+}
+
+/* METHODS ********************************************************************/
+void latency_record(latency_t *l, int64_t ns) {
+  assert(l);
+  uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+  uint64_t max = atomic_load_explicit(&l->max, memory_order_relaxed);
+  atomic_fetch_add_explicit(&l->buckets[bucket_index(v)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&l->sum, v, memory_order_relaxed);
+  atomic_fetch_add_explicit(&l->count, 1, memory_order_relaxed);
+  while (v > max && !atomic_compare_exchange_weak_explicit(
+                        &l->max, &max, v, memory_order_relaxed,
+                        memory_order_relaxed))
+    ;
+}
+
+void latency_reset(latency_t *l) {
+  assert(l);
+  size_t i;
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    atomic_store_explicit(&l->buckets[i], 0, memory_order_relaxed);
+  atomic_store_explicit(&l->count, 0, memory_order_relaxed);
+  atomic_store_explicit(&l->sum, 0, memory_order_relaxed);
+  atomic_store_explicit(&l->max, 0, memory_order_relaxed);
+}
+
+void latency_print(latency_t const *l, FILE *out, int header) {
+  assert(l && out);
+  if (header) {
+    fprintf(out, "%-12s %10s %9s %9s %9s %9s %9s %9s\n", "[us]", "count",
+            "mean", "sd", "p50", "p99", "p99.9", "max");
+  }
+  fprintf(out, "%-12s %10" PRIu64 " %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+          l->name, latency_count(l), latency_mean(l) / 1E3,
+          latency_sd(l) / 1E3, latency_percentile(l, 0.5) / 1E3,
+          latency_percentile(l, 0.99) / 1E3,
+          latency_percentile(l, 0.999) / 1E3, latency_max(l) / 1E3);
+}
+
+/* STATIC FUNCTIONS ***********************************************************/
+// Values below LATENCY_SUB have one bucket each; above that, the bucket is
+// given by the position of the leading bit and by the LATENCY_SUB_BITS bits
+// that follow it
+static size_t bucket_index(uint64_t v) {
+  int shift;
+  if (v < LATENCY_SUB)
+    return v;
+  shift = 63 - __builtin_clzll(v) - LATENCY_SUB_BITS;
+  return (shift + 1) * LATENCY_SUB + (v >> shift) - LATENCY_SUB;
+}
+
+static uint64_t bucket_low(size_t i) {
+  if (i < LATENCY_SUB)
+    return i;
+  return (uint64_t)(LATENCY_SUB + i % LATENCY_SUB) << (i / LATENCY_SUB - 1);
+}
+
+static uint64_t bucket_width(size_t i) {
+  if (i < LATENCY_SUB)
+    return 1;
+  return (uint64_t)1 << (i / LATENCY_SUB - 1);
+}
+
+/*
+ _          _                          _            _
+| |    __ _| |_ ___ _ __   ___ _   _  | |_ ___  ___| |_
+| |   / _` | __/ _ \ '_ \ / __| | | | | __/ _ \/ __| __|
+| |__| (_| | ||  __/ | | | (__| |_| | | ||  __/\__ \ |_
+|_____\__,_|\__\___|_| |_|\___|\__, |  \__\___||___/\__|
+                               |___/
+
+*/
+#ifdef LATENCY_MAIN
+int main() {
+  latency_t *l = latency_new("uniform");
+  int64_t i;
+  size_t b;
+  printf(BGRN "Latency class test executable, version %s (%s)\n" CRESET,
+         VERSION, BUILD_TYPE);
+
+  // bucket bounds are contiguous and hold their own values
+  for (b = 1; b < LATENCY_BUCKETS; b++) {
+    assert(bucket_low(b) == bucket_low(b - 1) + bucket_width(b - 1));
+    assert(bucket_index(bucket_low(b)) == b);
+    assert(bucket_index(bucket_low(b) + bucket_width(b) - 1) == b);
+  }
+  assert(bucket_index(UINT64_MAX) == LATENCY_BUCKETS - 1);
+
+  // uniform samples from 1 us to 1 ms: percentiles within bucket resolution
+  for (i = 1; i <= 1000; i++)
+    latency_record(l, i * 1000);
+  latency_record(l, -5);
+  latency_print(l, stdout, 1);
+  assert(latency_count(l) == 1001);
+  assert(latency_max(l) == 1000000);
+  assert(fabs(latency_percentile(l, 0.5) - 500000) < 500000.0 / LATENCY_SUB);
+  assert(fabs(latency_percentile(l, 0.99) - 990000) < 990000.0 / LATENCY_SUB);
+  assert(fabs(latency_sd(l) - 288819) < 288819.0 / LATENCY_SUB);
+  assert(latency_percentile(l, 1) == 1000000);
+
+  latency_reset(l);
+  assert(latency_count(l) == 0 && latency_percentile(l, 0.99) == 0);
+  latency_free(l);
+  return 0;
+}
+
+#endif
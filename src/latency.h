@@ -0,0 +1,70 @@
+/*
+ _          _                               _
+| |    __ _| |_ ___ _ __   ___ _   _    ___| | __ _ ___ ___
+| |   / _` | __/ _ \ '_ \ / __| | | |  / __| |/ _` / __/ __|
+| |__| (_| | ||  __/ | | | (__| |_| | | (__| | (_| \__ \__ \
+|_____\__,_|\__\___|_| |_|\___|\__, |  \___|_|\__,_|___/___/
+                               |___/
+
+* Lock-free latency histogram: samples in nanoseconds are counted in
+* log-linear buckets (HDR style, about 3% resolution), so that percentiles
+* can be read at any time without storing the samples
+*/
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "defines.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Latency class
+typedef struct latency latency_t;
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// Creates an empty histogram; name is used when printing
+latency_t *latency_new(char const *name);
+void latency_free(latency_t *l);
+
+
+/* ACCESSORS ******************************************************************/
+char const *latency_name(latency_t const *l);
+// Number of recorded samples
+uint64_t latency_count(latency_t const *l);
+// Largest recorded sample (ns)
+uint64_t latency_max(latency_t const *l);
+// Mean of the recorded samples (ns)
+data_t latency_mean(latency_t const *l);
+// Standard deviation of the recorded samples (ns), within bucket resolution
+data_t latency_sd(latency_t const *l);
+// Value below which the fraction p (0 to 1) of samples fall (ns)
+data_t latency_percentile(latency_t const *l, data_t p);
+
+
+/* METHODS ********************************************************************/
+// Records a sample (ns); negative values count as zero. Only atomic
+// increments are used, so one thread can record while another one reads
+void latency_record(latency_t *l, int64_t ns);
+// Clears all the samples
+void latency_reset(latency_t *l);
+// Prints a summary line (values in us); with header, prints column names first
+void latency_print(latency_t const *l, FILE *out, int header);
+
+
+#endif // LATENCY_H
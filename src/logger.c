@@ -0,0 +1,394 @@
+/*
+ _                                       _
+| |    ___   __ _  __ _  ___ _ __    ___| | __ _ ___ ___
+| |   / _ \ / _` |/ _` |/ _ \ '__|  / __| |/ _` / __/ __|
+| |__| (_) | (_| | (_| |  __/ |    | (__| | (_| \__ \__ \
+|_____\___/ \__, |\__, |\___|_|     \___|_|\__,_|___/___/
+            |___/ |___/
+
+* This is the implementation of the Logger class of C-CNC
+*/
+#include "logger.h"
+#include "queue.h"
+#include "rt.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Records in the queue: at 1 kHz, some 16 s of writer delay
+#define LOGGER_SIZE 16384
+// Writer polling interval when the queue is empty (s)
+#define LOGGER_POLL 0.01
+// Rows per chunk of the binary table
+#define LOGGER_CHUNK 4096
+
+// Columns of the binary table, in the order of the text table, with the
+// same precision. The total time is counted in sampling times (scale set to
+// tq); the block time is not a multiple of tq in continuous time, so it is
+// in microseconds
+static logger_field_t const logger_fields[LOGGER_FIELDS] = {
+    {"n", LOGGER_U32, 3, 0, 0, 1},         {"type", LOGGER_U8, 2, 0, 0, 1},
+    {"t_tot", LOGGER_U32, 0, 3, 0, 0},     {"t_blk", LOGGER_I32, 0, 3, 0, 1E-6},
+    {"lambda", LOGGER_I32, 0, 3, 0, 1E-3}, {"s", LOGGER_I32, 0, 3, 0, 1E-3},
+    {"feedrate", LOGGER_I32, 0, 1, 0, 1E-1}, {"x", LOGGER_I32, 0, 3, 0, 1E-3},
+    {"y", LOGGER_I32, 0, 3, 0, 1E-3},      {"z", LOGGER_I32, 0, 3, 0, 1E-3}};
+
+// Structure representing the Logger class
+typedef struct logger {
+  queue_t *queue;         // records, from the loop to the writer
+  FILE *out;              // trajectory table
+  int binary;             // write the binary table instead of text
+  logger_field_t fields[LOGGER_FIELDS]; // binary table columns
+  void *columns[LOGGER_FIELDS];         // rows of the current chunk
+  size_t rows;                          // rows in the current chunk
+  data_t progress_period; // time between progress updates (s, 0: never)
+  data_t progress_time;   // time of the last progress update (s)
+  data_t progress;        // last progress value (%), < 0 when shown
+  pthread_t writer;       // writer thread
+  int running;            // writer thread started
+  atomic_int stop;        // asks the writer to quit
+  atomic_int flush;       // asks the writer to write out a partial chunk
+  atomic_size_t written;  // records handled by the writer
+  size_t pushed;          // records queued by the loop
+  atomic_size_t dropped;  // records lost on a full queue
+} logger_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* STATIC FUNCTIONS ***********************************************************/
+static void *logger_writer(void *arg);
+static void logger_write(logger_t *l, logger_record_t const *r);
+static void logger_progress(logger_t *l, int force);
+static ccnc_error_t logger_binary_start(logger_t *l, data_t tq);
+static void logger_chunk_add(logger_t *l, logger_record_t const *r);
+static void logger_chunk_write(logger_t *l, int run);
+static data_t logger_now();
+static void logger_sleep(data_t seconds);
+
+/* LIFECYCLE ******************************************************************/
+logger_t *logger_new(machine_t const *m, FILE *out) {
+  assert(m && out);
+  logger_t *l = malloc(sizeof(logger_t));
+  if (!l) {
+    eprintf("Error allocating memory for a logger\n");
+    return NULL;
+  }
+  memset(l, 0, sizeof(*l));
+  l->out = out;
+  l->progress = -1;
+  if (strcmp(machine_log_format(m), "binary") == 0) {
+    l->binary = 1;
+  } else if (strcmp(machine_log_format(m), "text") != 0) {
+    wprintf("Unknown log format %s, using text\n", machine_log_format(m));
+  }
+  if (machine_progress(m) > 0) {
+    l->progress_period = 1.0 / machine_progress(m);
+  }
+  l->queue = queue_new(LOGGER_SIZE, sizeof(logger_record_t));
+  if (!l->queue) {
+    free(l);
+    return NULL;
+  }
+  if (l->binary && logger_binary_start(l, machine_tq(m)) != NO_ERR) {
+    logger_free(l);
+    return NULL;
+  }
+  if (rt_helper_create(&l->writer, logger_writer, l)) {
+    eprintf("Could not start the log writer thread\n");
+    logger_free(l);
+    return NULL;
+  }
+  l->running = 1;
+  return l;
+}
+
+void logger_free(logger_t *l) {
+  assert(l);
+  size_t k;
+  if (l->running) {
+    atomic_store(&l->stop, 1);
+    pthread_join(l->writer, NULL);
+  }
+  if (logger_dropped(l) > 0) {
+    eprintf("Lost %zu log records: the log writer could not keep up\n",
+            logger_dropped(l));
+  }
+  for (k = 0; k < LOGGER_FIELDS; k++)
+    free(l->columns[k]);
+  queue_free(l->queue);
+  free(l);
+  l = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+size_t logger_dropped(logger_t const *l) {
+  assert(l);
+  return atomic_load(&l->dropped);
+}
+
+/* METHODS ********************************************************************/
+void logger_push(logger_t *l, logger_record_t const *r) {
+  assert(l && r);
+  if (queue_push(l->queue, r)) {
+    l->pushed++;
+  } else {
+    atomic_fetch_add(&l->dropped, 1);
+  }
+}
+
+void logger_flush(logger_t *l) {
+  assert(l);
+  atomic_store(&l->flush, 1);
+  while (atomic_load(&l->written) < l->pushed || atomic_load(&l->flush)) {
+    logger_sleep(LOGGER_POLL / 10);
+  }
+}
+
+/* STATIC FUNCTIONS ***********************************************************/
+// Drains the queue, then flushes the output and sleeps until new records
+// arrive. On stop, the records still in the queue are written. Binary
+// chunks are written when full, or partially when flushing or stopping
+static void *logger_writer(void *arg) {
+  logger_t *l = (logger_t *)arg;
+  logger_record_t r;
+  int stop = 0, flush = 0, pending = 0;
+  do {
+    stop = atomic_load(&l->stop);
+    flush = atomic_load(&l->flush);
+    while (queue_pop(l->queue, &r)) {
+      logger_write(l, &r);
+      pending = 1;
+    }
+    if (l->binary && l->rows > 0 && (flush || stop)) {
+      logger_chunk_write(l, 0);
+    }
+    if (pending || flush) {
+      logger_progress(l, 0);
+      fflush(l->out);
+      pending = 0;
+    }
+    if (flush)
+      atomic_store(&l->flush, 0);
+    if (!stop)
+      logger_sleep(LOGGER_POLL);
+  } while (!stop);
+  logger_progress(l, 1);
+  return NULL;
+}
+
+static void logger_write(logger_t *l, logger_record_t const *r) {
+  switch (r->kind) {
+  case LOGGER_HEADER:
+    if (l->binary)
+      logger_chunk_write(l, 1);
+    else
+      fprintf(l->out, "#n type t_tot t_blk lambda s feedrate x y z\n");
+    break;
+  case LOGGER_BLOCK:
+    // the summary overwrites the progress of the previous block
+    logger_progress(l, 1);
+    fprintf(stderr, "\r%03lu G%02d L%8.3f\n", r->n, r->type, r->s);
+    if (r->type == NO_MOTION)
+      fprintf(stderr, "No motion block %zu\n", r->n);
+    fflush(stderr);
+    l->progress = -1;
+    break;
+  case LOGGER_ROW:
+    if (l->binary) {
+      logger_chunk_add(l, r);
+    } else {
+      fprintf(l->out, "%03lu %02d %.3f %.3f %.3f %.3f %.1f %.3f %.3f %.3f\n",
+              r->n, r->type, r->t_tot, r->t_blk, r->lambda, r->s, r->feedrate,
+              r->x, r->y, r->z);
+    }
+    l->progress = r->lambda * 100;
+    logger_progress(l, 0);
+    break;
+  }
+  atomic_fetch_add(&l->written, 1);
+}
+
+// Prints the last progress value, if not shown yet and either forced or
+// enough time has passed since the last update
+static void logger_progress(logger_t *l, int force) {
+  data_t now;
+  if (l->progress_period <= 0 || l->progress < 0)
+    return;
+  now = logger_now();
+  if (force || now - l->progress_time >= l->progress_period) {
+    fprintf(stderr, "\r[%5.1f%%]", l->progress);
+    fflush(stderr);
+    l->progress_time = now;
+    l->progress = -1;
+  }
+}
+
+// Writes the file header and allocates the chunk columns
+static ccnc_error_t logger_binary_start(logger_t *l, data_t tq) {
+  logger_file_t header = {.magic = LOGGER_MAGIC,
+                          .version = LOGGER_VERSION,
+                          .fields = LOGGER_FIELDS,
+                          .chunk_rows = LOGGER_CHUNK,
+                          .tq = tq};
+  size_t k;
+  memcpy(l->fields, logger_fields, sizeof(l->fields));
+  l->fields[2].scale = tq;
+  for (k = 0; k < LOGGER_FIELDS; k++) {
+    l->columns[k] = malloc(logger_column_size(&l->fields[k], LOGGER_CHUNK));
+    if (!l->columns[k]) {
+      eprintf("Error allocating memory for the log columns\n");
+      return ALLOC_ERR;
+    }
+  }
+  if (fwrite(&header, sizeof(header), 1, l->out) != 1 ||
+      fwrite(l->fields, sizeof(l->fields), 1, l->out) != 1) {
+    eprintf("Could not write the log header\n");
+    return FILE_ERR;
+  }
+  return NO_ERR;
+}
+
+// Appends a row to the current chunk, converted to fixed point
+static void logger_chunk_add(logger_t *l, logger_record_t const *r) {
+  data_t v[LOGGER_FIELDS] = {r->n,      r->type,     r->t_tot, r->t_blk,
+                             r->lambda, r->s,        r->feedrate,
+                             r->x,      r->y,        r->z};
+  size_t k;
+  for (k = 0; k < LOGGER_FIELDS; k++) {
+    long raw = lround(v[k] / l->fields[k].scale);
+    switch (l->fields[k].type) {
+    case LOGGER_U8:
+      ((uint8_t *)l->columns[k])[l->rows] = raw;
+      break;
+    case LOGGER_U32:
+      ((uint32_t *)l->columns[k])[l->rows] = raw;
+      break;
+    default:
+      ((int32_t *)l->columns[k])[l->rows] = raw;
+    }
+  }
+  if (++l->rows == LOGGER_CHUNK)
+    logger_chunk_write(l, 0);
+}
+
+// Writes the current chunk, if not empty; with run, writes an empty chunk
+// after it, as a run marker
+static void logger_chunk_write(logger_t *l, int run) {
+  static uint64_t const padding = 0;
+  logger_chunk_t chunk = {.rows = l->rows};
+  size_t k, size;
+  if (l->rows > 0) {
+    fwrite(&chunk, sizeof(chunk), 1, l->out);
+    for (k = 0; k < LOGGER_FIELDS; k++) {
+      size = l->rows * (l->fields[k].type == LOGGER_U8 ? 1 : 4);
+      fwrite(l->columns[k], size, 1, l->out);
+      fwrite(&padding, logger_column_size(&l->fields[k], l->rows) - size, 1,
+             l->out);
+    }
+    l->rows = 0;
+  }
+  if (run) {
+    chunk.rows = 0;
+    fwrite(&chunk, sizeof(chunk), 1, l->out);
+  }
+}
+
+static data_t logger_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+static void logger_sleep(data_t seconds) {
+  struct timespec ts = {.tv_sec = 0, .tv_nsec = seconds * 1E9};
+  nanosleep(&ts, NULL);
+}
+
+/*
+ _                                  _            _
+| |    ___   __ _  __ _  ___ _ __  | |_ ___  ___| |_
+| |   / _ \ / _` |/ _` |/ _ \ '__| | __/ _ \/ __| __|
+| |__| (_) | (_| | (_| |  __/ |    | ||  __/\__ \ |_
+|_____\___/ \__, |\__, |\___|_|     \__\___||___/\__|
+            |___/ |___/
+
+*/
+#ifdef LOGGER_MAIN
+#define LOGGER_ROWS 100000
+
+int main(int argc, char const **argv) {
+  machine_t *m = NULL;
+  logger_t *l = NULL;
+  FILE *out = tmpfile();
+  logger_record_t r = {.kind = LOGGER_ROW, .type = LINE, .n = 10};
+  char line[128];
+  size_t i, rows = 0;
+  data_t t0 = 0, dt = 0;
+  struct timespec ts;
+
+  if (argc != 2) {
+    eprintf("I need exactly one argument: INI file\n");
+    exit(EXIT_FAILURE);
+  }
+  m = machine_new(argv[1]);
+  l = m ? logger_new(m, out) : NULL;
+  if (!l || !out) {
+    exit(EXIT_FAILURE);
+  }
+
+  // pushing only copies the record: time it on the real-time side
+  r.kind = LOGGER_HEADER;
+  logger_push(l, &r);
+  r.kind = LOGGER_ROW;
+  for (i = 0; i < LOGGER_ROWS; i++) {
+    // at most LOGGER_SIZE records in flight; waiting is not timed
+    if (i % (LOGGER_SIZE / 2) == 0) {
+      logger_flush(l);
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      t0 = ts.tv_sec + ts.tv_nsec / 1E9;
+    }
+    r.t_tot = i * machine_tq(m);
+    r.lambda = i / (data_t)LOGGER_ROWS;
+    logger_push(l, &r);
+    if (i % (LOGGER_SIZE / 2) == LOGGER_SIZE / 2 - 1 || i == LOGGER_ROWS - 1) {
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      dt += ts.tv_sec + ts.tv_nsec / 1E9 - t0;
+    }
+  }
+  logger_flush(l);
+  printf("\nQueued %d rows in %.3f s (%.0f ns per row), %zu dropped\n",
+         LOGGER_ROWS, dt, dt / LOGGER_ROWS * 1E9, logger_dropped(l));
+
+  // every row has been written, in order
+  rewind(out);
+  while (fgets(line, sizeof(line), out)) {
+    if (line[0] != '#')
+      rows++;
+  }
+  printf("Written %zu rows\n", rows);
+  assert(rows == LOGGER_ROWS && logger_dropped(l) == 0);
+
+  logger_free(l);
+  machine_free(m);
+  fclose(out);
+  return 0;
+}
+
+#endif // LOGGER_MAIN
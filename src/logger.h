@@ -0,0 +1,140 @@
+/*
+ _                                       _
+| |    ___   __ _  __ _  ___ _ __    ___| | __ _ ___ ___
+| |   / _ \ / _` |/ _` |/ _ \ '__|  / __| |/ _` / __/ __|
+| |__| (_) | (_| | (_| |  __/ |    | (__| | (_| \__ \__ \
+|_____\___/ \__, |\__, |\___|_|     \___|_|\__,_|___/___/
+            |___/ |___/
+
+* Asynchronous trajectory logger: the real-time loop copies raw records into
+* a lock-free queue, and a background thread formats and writes them, and
+* updates the progress on the terminal at a limited rate
+*/
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "defines.h"
+#include "block.h"
+#include "machine.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Logger class
+typedef struct logger logger_t;
+
+// Kinds of log records
+typedef enum {
+  LOGGER_HEADER, // start of a program run: the table header
+  LOGGER_BLOCK,  // start of a block: a summary on stderr
+  LOGGER_ROW     // one table row per sampling time
+} logger_kind_t;
+
+// Binary trajectory table (log_format = "binary"): a logger_file_t header,
+// fields logger_field_t descriptors, then chunks of rows. Each chunk is a
+// logger_chunk_t followed by one column per field (in fixed point, value =
+// raw * scale), each padded to a multiple of 8 bytes. A chunk with no rows
+// marks the start of a program run
+#define LOGGER_MAGIC "CCNCLOG"
+#define LOGGER_VERSION 2
+#define LOGGER_FIELDS 10
+
+// Column types
+typedef enum { LOGGER_U8 = 1, LOGGER_U32, LOGGER_I32 } logger_type_t;
+
+typedef struct {
+  char magic[8];       // LOGGER_MAGIC
+  uint32_t version;    // LOGGER_VERSION
+  uint32_t fields;     // number of columns
+  uint32_t chunk_rows; // max rows per chunk
+  uint32_t reserved;
+  data_t tq;           // sampling time (s)
+} logger_file_t;
+
+typedef struct {
+  char name[12];    // column name, as in the text table header
+  uint8_t type;     // logger_type_t
+  uint8_t width;    // zero-padded width of integer columns in text
+  uint8_t decimals; // decimals in text (0 for integer columns)
+  uint8_t reserved;
+  data_t scale;     // value of one raw unit
+} logger_field_t;
+
+typedef struct {
+  uint32_t rows; // rows in the chunk (0: start of a run)
+  uint32_t reserved;
+} logger_chunk_t;
+
+// Log record: a row of the trajectory table. Block records only use n,
+// type and s (block length)
+typedef struct {
+  logger_kind_t kind;
+  block_type_t type; // block type
+  size_t n;          // block number
+  data_t t_tot;      // time since the program start (s)
+  data_t t_blk;      // time since the block start (s)
+  data_t lambda;     // block fraction (remaining fraction, for rapids)
+  data_t s;          // curvilinear abscissa (mm)
+  data_t feedrate;   // feedrate (mm/min)
+  data_t x, y, z;    // position (mm)
+} logger_record_t;
+
+
+// Size of a column of the binary table, with padding
+static inline size_t logger_column_size(logger_field_t const *f, size_t rows) {
+  size_t size = rows * (f->type == LOGGER_U8 ? 1 : 4);
+  return (size + 7) / 8 * 8;
+}
+
+// Value of row i of a column of the binary table
+static inline data_t logger_column_value(logger_field_t const *f,
+                                         void const *column, size_t i) {
+  switch (f->type) {
+  case LOGGER_U8:
+    return ((uint8_t const *)column)[i] * f->scale;
+  case LOGGER_U32:
+    return ((uint32_t const *)column)[i] * f->scale;
+  default:
+    return ((int32_t const *)column)[i] * f->scale;
+  }
+}
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// Starts the writer thread: rows go to out, in the [C-CNC]:log_format
+// format (text or binary), and progress to stderr, [C-CNC]:progress times
+// per second
+logger_t *logger_new(machine_t const *m, FILE *out);
+// Writes the pending records, then stops the writer thread
+void logger_free(logger_t *l);
+
+
+/* ACCESSORS ******************************************************************/
+// Records lost since the queue was full
+size_t logger_dropped(logger_t const *l);
+
+
+/* METHODS ********************************************************************/
+// Real-time side: queues a copy of the record, never blocks (the record is
+// dropped if the writer is too late)
+void logger_push(logger_t *l, logger_record_t const *r);
+// Waits until all the queued records have been written
+void logger_flush(logger_t *l);
+
+
+#endif // LOGGER_H
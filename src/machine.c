@@ -11,6 +11,8 @@
 #include "toml.h"
 #include <mqtt_protocol.h>
 #include <signal.h> // for signal handling
+#include <stdatomic.h>
+#include <time.h>   // for clock_gettime
 #include <unistd.h> // for usleep
 
 /*
@@ -22,25 +24,58 @@
 
 */
 #define BUFLEN 1024
+#define MACHINE_SETPOINT_JSON 128 // room for one JSON setpoint in a batch
+
+// Feedback written by the network thread and read by the control loop under
+// a seqlock: seq is odd while an update is in progress, and readers retry
+// until they see the same even value before and after reading. Fields are
+// relaxed atomics, so that racing reads are well defined (and discarded)
+typedef struct {
+  atomic_uint seq;                  // twice the updates, +1 while writing
+  _Atomic data_t x, y, z, error;    // position and error (mm)
+  _Atomic uint64_t timestamp;       // last update (ns, CLOCK_MONOTONIC)
+} feedback_t;
 
 typedef struct machine {
   data_t A;                     // Maximum acceleration (m/s/s)
+  data_t J;                     // Maximum jerk (m/s/s/s, 0: infinite)
   data_t tq;                    // Sampling time (s)
-  data_t max_error, error;      // Maximum and actual positioning error (mm)
+  data_t max_error;             // Maximum positioning error (mm)
   data_t fmax;                  // Maximum feedrate (mm/min)
-  point_t *zero;                // Initial machine position
-  point_t *setpoint, *position; // Setpoint and actual position
-  point_t *offset;              // Workpiece origin coordinates
+  point_t zero;                 // Initial machine position
+  point_t setpoint, position;   // Setpoint and actual position
+  feedback_t feedback;          // Actual position and error, as received
+  point_t offset;               // Workpiece origin coordinates
+  point_t axis_A, axis_fmax;    // Per-axis limits ([X], [Y], [Z] sections)
   /* MQTT SECTION */
   char broker_address[BUFLEN];
   int broker_port;
   char pub_topic[BUFLEN];
   char sub_topic[BUFLEN];
+  char payload[BUFLEN];         // setpoint payload format (json or binary)
+  int binary;                   // payload is binary
+  uint32_t seq;                 // sequence number of binary setpoints
+  int batch;                    // setpoints per message (1: one per tick)
+  char *batch_buffer;           // pending batched setpoints, encoded
+  size_t batch_len;             // encoded bytes in batch_buffer
+  int batch_count;              // setpoints in batch_buffer
+  struct timespec batch_t0;     // time of the first setpoint in the batch
   char msg_buffer[BUFLEN];
   struct mosquitto *mqt;
   struct mosquitto_message *msg;
-  int connecting;
+  atomic_int connecting;
   data_t rt_pacing;
+  int rt_priority;              // SCHED_FIFO priority (0: default scheduler)
+  int rt_cpu;                   // CPU the main loop is pinned to (-1: any)
+  int rt_lock;                  // Lock memory pages in RAM (0 disables)
+  int lookahead;                // Look-ahead window (blocks, 0 disables)
+  int stream;                   // Streaming window (blocks, 0 disables)
+  int threads;                  // Parser threads (0: one per CPU core)
+  int cache;                    // Save/load parsed programs (0 disables)
+  int queue;                    // Setpoints interpolated ahead of the loop
+  int continuous;               // Exact block durations (0: tq multiples)
+  char log_format[BUFLEN];      // Trajectory log format (text or binary)
+  int progress;                 // Progress updates per second (0 disables)
 } machine_t;
 
 // MQTT Callbacks:
@@ -48,6 +83,17 @@ static void on_connect(struct mosquitto *, void *, int);
 static void on_message(struct mosquitto *, void *,
                        const struct mosquitto_message *);
 static void on_disconnect(struct mosquitto *, void *, int);
+static void feedback_write(machine_t *m, point_t const *pos,
+                           data_t const *error);
+
+// Little endian encoding of binary payloads
+static void put_u32(unsigned char *buf, uint32_t v);
+static void put_u64(unsigned char *buf, uint64_t v);
+static void put_f64(unsigned char *buf, double v);
+static double get_f64(unsigned char const *buf);
+static size_t encode_setpoint(machine_t const *m, unsigned char *buf,
+                              point_t const *sp, uint32_t flags, uint32_t seq,
+                              uint64_t ns);
 
 /*
   _____                 _   _
@@ -76,19 +122,26 @@ machine_t *machine_new(char const *config_path) {
   // 1. Set defaults ===========================================================
   memset(m, 0, sizeof(*m));
   m->A = 100;
+  m->J = 0;
   m->max_error = 0.010;
-  m->error = 0.0;
   m->tq = 0.005;
-  m->zero = point_new();
-  m->setpoint = point_new();
-  m->position = point_new();
-  m->offset = point_new();
-  m->connecting = 1;
+  atomic_init(&m->connecting, 1);
   m->rt_pacing = 1;
-  point_set_xyz(m->zero, 0, 0, 0);
-  point_set_xyz(m->setpoint, 0, 0, 0);
-  point_set_xyz(m->position, 0, 0, 0);
-  point_set_xyz(m->offset, 0, 0, 0);
+  m->rt_priority = 0;
+  m->rt_cpu = -1;
+  m->rt_lock = 0;
+  m->lookahead = 0;
+  m->stream = 0;
+  m->threads = 1;
+  m->queue = 1024;
+  strncpy(m->log_format, "text", BUFLEN);
+  strncpy(m->payload, "json", BUFLEN);
+  m->progress = 10;
+  m->batch = 1;
+  point_set_xyz(&m->zero, 0, 0, 0);
+  point_set_xyz(&m->setpoint, 0, 0, 0);
+  point_set_xyz(&m->position, 0, 0, 0);
+  point_set_xyz(&m->offset, 0, 0, 0);
 
   // 2. Open the INI file ======================================================
   ini_file = fopen(config_path, "r");
@@ -148,27 +201,63 @@ machine_t *machine_new(char const *config_path) {
     return NULL;
   }
   T_READ_D(d, m, ccnc, A);
+  T_READ_D(d, m, ccnc, J);
   T_READ_D(d, m, ccnc, max_error);
   T_READ_D(d, m, ccnc, tq);
   T_READ_D(d, m, ccnc, fmax);
   T_READ_D(d, m, ccnc, rt_pacing);
+  T_READ_I(d, m, ccnc, rt_priority);
+  T_READ_I(d, m, ccnc, rt_cpu);
+  T_READ_I(d, m, ccnc, rt_lock);
+  T_READ_I(d, m, ccnc, lookahead);
+  T_READ_I(d, m, ccnc, stream);
+  T_READ_I(d, m, ccnc, threads);
+  T_READ_I(d, m, ccnc, cache);
+  T_READ_I(d, m, ccnc, queue);
+  T_READ_I(d, m, ccnc, continuous);
+  T_READ_S(d, m, ccnc, log_format);
+  T_READ_I(d, m, ccnc, progress);
 
   // Arrays must be read in a different way (using toml_double_at()):
   toml_array_t *point = toml_array_in(ccnc, "zero");
   if (!point) {
     wprintf("Missing C-CNC:zero, using default\n");
   } else {
-    point_set_xyz(m->zero, toml_double_at(point, 0).u.d,
+    point_set_xyz(&m->zero, toml_double_at(point, 0).u.d,
                   toml_double_at(point, 1).u.d, toml_double_at(point, 2).u.d);
   }
   point = toml_array_in(ccnc, "offset");
   if (!point) {
     wprintf("Missing C-CNC:offset, using default\n");
   } else {
-    point_set_xyz(m->offset, toml_double_at(point, 0).u.d,
+    point_set_xyz(&m->offset, toml_double_at(point, 0).u.d,
                   toml_double_at(point, 1).u.d, toml_double_at(point, 2).u.d);
   }
 
+  // per-axis limits are optional, in the axes sections: missing ones are
+  // the same as C-CNC:A and C-CNC:fmax, which remain the limits along the
+  // path
+  {
+    char const *axes[] = {"X", "Y", "Z"};
+    data_t acc[3], feed[3];
+    toml_table_t *axis = NULL;
+    int i;
+    for (i = 0; i < 3; i++) {
+      acc[i] = m->A;
+      feed[i] = m->fmax;
+      if (!(axis = toml_table_in(conf, axes[i])))
+        continue;
+      d = toml_double_in(axis, "A");
+      if (d.ok)
+        acc[i] = d.u.d;
+      d = toml_double_in(axis, "fmax");
+      if (d.ok)
+        feed[i] = d.u.d;
+    }
+    point_set_xyz(&m->axis_A, acc[0], acc[1], acc[2]);
+    point_set_xyz(&m->axis_fmax, feed[0], feed[1], feed[2]);
+  }
+
   // read the MQTT section
   toml_table_t *mqtt = toml_table_in(conf, "MQTT");
   if (!mqtt) {
@@ -180,6 +269,27 @@ machine_t *machine_new(char const *config_path) {
   T_READ_I(d, m, mqtt, broker_port);
   T_READ_S(d, m, mqtt, pub_topic);
   T_READ_S(d, m, mqtt, sub_topic);
+  T_READ_S(d, m, mqtt, payload);
+  if (strcmp(m->payload, "binary") == 0) {
+    m->binary = 1;
+  } else if (strcmp(m->payload, "json") != 0) {
+    wprintf("Unknown MQTT payload %s, using json\n", m->payload);
+    strncpy(m->payload, "json", BUFLEN);
+  }
+  T_READ_I(d, m, mqtt, batch);
+  if (m->batch < 1 || m->batch > MACHINE_BATCH_MAX) {
+    wprintf("MQTT:batch must be in 1..%d, using 1\n", MACHINE_BATCH_MAX);
+    m->batch = 1;
+  }
+  if (m->batch > 1) {
+    m->batch_buffer = malloc(m->batch * MACHINE_SETPOINT_JSON + 2);
+    if (!m->batch_buffer) {
+      eprintf("Could not allocate memory for setpoint batches\n");
+      toml_free(conf);
+      machine_free(m);
+      return NULL;
+    }
+  }
 
   // Initialize MQTT library
   if (mosquitto_lib_init() != MOSQ_ERR_SUCCESS) {
@@ -195,12 +305,7 @@ machine_t *machine_new(char const *config_path) {
 
 void machine_free(machine_t *m) {
   assert(m);
-  if (m->zero)
-    point_free(m->zero);
-  if (m->position)
-    point_free(m->position);
-  if (m->setpoint)
-    point_free(m->setpoint);
+  free(m->batch_buffer);
   free(m);
   m = NULL;
 }
@@ -214,31 +319,104 @@ void machine_free(machine_t *m) {
   }
 
 machine_getter(data_t, A);
+machine_getter(data_t, J);
 machine_getter(data_t, tq);
 machine_getter(data_t, max_error);
-machine_getter(data_t, error);
 machine_getter(data_t, fmax);
 machine_getter(data_t, rt_pacing);
-machine_getter(point_t *, zero);
-machine_getter(point_t *, setpoint);
-machine_getter(point_t *, position);
+machine_getter(int, rt_priority);
+machine_getter(int, rt_cpu);
+machine_getter(int, rt_lock);
 machine_getter(int, connecting);
+machine_getter(int, lookahead);
+machine_getter(int, stream);
+machine_getter(int, threads);
+machine_getter(int, cache);
+machine_getter(int, queue);
+machine_getter(int, continuous);
+machine_getter(char const *, log_format);
+machine_getter(int, progress);
+machine_getter(int, batch);
+
+// points are embedded in the machine object
+#define machine_point_getter(par)                                              \
+  point_t *machine_##par(machine_t const *m) {                                 \
+    assert(m);                                                                 \
+    return (point_t *)&m->par;                                                 \
+  }
+
+machine_point_getter(zero);
+machine_point_getter(setpoint);
+machine_point_getter(axis_A);
+machine_point_getter(axis_fmax);
+
+// Feedback is written by the network thread: these read a consistent
+// snapshot (see machine_feedback())
+data_t machine_error(machine_t const *m) {
+  machine_feedback_t fb;
+  machine_feedback(m, &fb);
+  return fb.error;
+}
+
+point_t *machine_position(machine_t const *m) {
+  machine_feedback_t fb;
+  machine_feedback(m, &fb);
+  ((machine_t *)m)->position = fb.position;
+  return (point_t *)&m->position;
+}
 
 /* METHODS ********************************************************************/
 
+void machine_feedback(machine_t const *m, machine_feedback_t *fb) {
+  assert(m && fb);
+  feedback_t *f = (feedback_t *)&m->feedback;
+  unsigned int s1, s2;
+  do {
+    s1 = atomic_load_explicit(&f->seq, memory_order_acquire);
+    point_set_xyz(&fb->position,
+                  atomic_load_explicit(&f->x, memory_order_relaxed),
+                  atomic_load_explicit(&f->y, memory_order_relaxed),
+                  atomic_load_explicit(&f->z, memory_order_relaxed));
+    fb->error = atomic_load_explicit(&f->error, memory_order_relaxed);
+    fb->timestamp = atomic_load_explicit(&f->timestamp, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    s2 = atomic_load_explicit(&f->seq, memory_order_relaxed);
+  } while (s1 != s2 || (s1 & 1));
+  fb->seq = s1 / 2;
+}
+
 void machine_print_params(machine_t const *m, FILE *out) {
   fprintf(out, BGRN "Machine parameters:\n" CRESET);
   fprintf(out, BBLK "C-CNC:A:         " CRESET "%f\n", m->A);
+  fprintf(out, BBLK "C-CNC:J:         " CRESET "%f\n", m->J);
   fprintf(out, BBLK "C-CNC:tq:        " CRESET "%f\n", m->tq);
   fprintf(out, BBLK "C-CNC:fmax:      " CRESET "%f\n", m->fmax);
   fprintf(out, BBLK "C-CNC:max_error: " CRESET "%f\n", m->max_error);
   fprintf(out, BBLK "C-CNC:zero:      " CRESET "[%.3f, %.3f, %.3f]\n",
-          point_x(m->zero), point_y(m->zero), point_z(m->zero));
+          point_x(&m->zero), point_y(&m->zero), point_z(&m->zero));
   fprintf(out, BBLK "C-CNC:rt_pacing:  " CRESET "%f\n", m->rt_pacing);
+  fprintf(out, BBLK "C-CNC:rt_priority: " CRESET "%d\n", m->rt_priority);
+  fprintf(out, BBLK "C-CNC:rt_cpu:     " CRESET "%d\n", m->rt_cpu);
+  fprintf(out, BBLK "C-CNC:rt_lock:    " CRESET "%d\n", m->rt_lock);
+  fprintf(out, BBLK "C-CNC:lookahead:  " CRESET "%d\n", m->lookahead);
+  fprintf(out, BBLK "C-CNC:stream:     " CRESET "%d\n", m->stream);
+  fprintf(out, BBLK "C-CNC:threads:    " CRESET "%d\n", m->threads);
+  fprintf(out, BBLK "C-CNC:cache:      " CRESET "%d\n", m->cache);
+  fprintf(out, BBLK "C-CNC:queue:      " CRESET "%d\n", m->queue);
+  fprintf(out, BBLK "C-CNC:continuous: " CRESET "%d\n", m->continuous);
+  fprintf(out, BBLK "C-CNC:log_format: " CRESET "%s\n", m->log_format);
+  fprintf(out, BBLK "C-CNC:progress:   " CRESET "%d\n", m->progress);
+  fprintf(out, BBLK "XYZ:A:           " CRESET "[%.3f, %.3f, %.3f]\n",
+          point_x(&m->axis_A), point_y(&m->axis_A), point_z(&m->axis_A));
+  fprintf(out, BBLK "XYZ:fmax:        " CRESET "[%.3f, %.3f, %.3f]\n",
+          point_x(&m->axis_fmax), point_y(&m->axis_fmax),
+          point_z(&m->axis_fmax));
   fprintf(out, BBLK "MQTT:broker_addr: " CRESET "%s\n", m->broker_address);
   fprintf(out, BBLK "MQTT:broker_port: " CRESET "%d\n", m->broker_port);
   fprintf(out, BBLK "MQTT:pub_topic: " CRESET "%s\n", m->pub_topic);
   fprintf(out, BBLK "MQTT:sub_topic: " CRESET "%s\n", m->sub_topic);
+  fprintf(out, BBLK "MQTT:payload:   " CRESET "%s\n", m->payload);
+  fprintf(out, BBLK "MQTT:batch:     " CRESET "%d\n", m->batch);
 }
 
 // Connect with the broker and setup callbacks
@@ -261,12 +439,26 @@ ccnc_error_t machine_connect(machine_t *m, machine_on_message callback) {
   else
     mosquitto_message_callback_set(m->mqt, callback);
 
-  // Connect to the broker
+  // Connect to the broker, then run the network I/O on its own thread:
+  // publishing only queues the messages, so the control loop never blocks
+  // on the socket
   if (mosquitto_connect(m->mqt, m->broker_address, m->broker_port, 60) !=
       MOSQ_ERR_SUCCESS) {
     eprintf("Invalid broker parameters\n");
     return MQTT_ERR;
   }
+  if (mosquitto_loop_start(m->mqt) != MOSQ_ERR_SUCCESS) {
+    eprintf("Could not start the MQTT network thread\n");
+    mosquitto_disconnect(m->mqt);
+    return MQTT_ERR;
+  }
+
+  // Announce the payload format to the subscribers (retained)
+  if (snprintf(m->msg_buffer, BUFLEN, "%s/format", m->pub_topic) >= BUFLEN ||
+      mosquitto_publish(m->mqt, NULL, m->msg_buffer, strlen(m->payload),
+                        m->payload, 0, 1) != MOSQ_ERR_SUCCESS) {
+    wprintf("Could not publish the payload format on %s\n", m->msg_buffer);
+  }
   return NO_ERR;
 }
 
@@ -274,20 +466,64 @@ ccnc_error_t machine_connect(machine_t *m, machine_on_message callback) {
 // i.e. publish m->setpoint via MQTT
 ccnc_error_t machine_sync(machine_t *m, int rapid) {
   assert(m && m->mqt);
-  int rc = 0;
-  // Transmit a setpoint description in JSON like this:
-  // {"x":1.1,"y":23.0,"z":123.0,"rapid":1}
-  snprintf(m->msg_buffer, BUFLEN, "{\"x\":%f,\"y\":%f,\"z\":%f,\"rapid\":%d}",
-           point_x(m->setpoint) + point_x(m->offset),
-           point_y(m->setpoint) + point_y(m->offset),
-           point_z(m->setpoint) + point_z(m->offset), rapid);
-  rc = mosquitto_publish(m->mqt, NULL, m->pub_topic, strlen(m->msg_buffer),
-                        m->msg_buffer, 0, 0);
+  int rc = 0, len = 0;
+  uint64_t ns = 0;
+  struct timespec now;
+  // a single setpoint supersedes any pending batch
+  m->batch_len = m->batch_count = 0;
+  if (m->binary) {
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+  }
+  len = encode_setpoint(m, (unsigned char *)m->msg_buffer, &m->setpoint,
+                        rapid ? MACHINE_RAPID : 0, m->seq++, ns);
+  rc = mosquitto_publish(m->mqt, NULL, m->pub_topic, len, m->msg_buffer, 0, 0);
+  if (rc != MOSQ_ERR_SUCCESS) {
+    eprintf("(code: %d) Could not send setpoint message\n", rc);
+    return MQTT_ERR;
+  }
+  return NO_ERR;
+}
+
+// queue a setpoint due delay seconds after the first one in the batch,
+// flagged as rapid or not as with machine_sync(); the batch is published
+// when [MQTT]:batch setpoints are queued
+ccnc_error_t machine_batch_push(machine_t *m, point_t const *sp, data_t delay,
+                                int rapid) {
+  assert(m && m->mqt && sp && m->batch > 1);
+  uint64_t ns;
+  unsigned char *buf = (unsigned char *)m->batch_buffer + m->batch_len;
+  if (m->batch_count == 0) {
+    clock_gettime(CLOCK_REALTIME, &m->batch_t0);
+    if (!m->binary)
+      *buf++ = '[', m->batch_len++;
+  } else if (!m->binary) {
+    *buf++ = ',', m->batch_len++;
+  }
+  ns = m->batch_t0.tv_sec * 1000000000ULL + m->batch_t0.tv_nsec +
+       (uint64_t)(delay * 1E9);
+  m->batch_len += encode_setpoint(
+      m, buf, sp, MACHINE_BATCHED | (rapid ? MACHINE_RAPID : 0), m->seq++, ns);
+  if (++m->batch_count == m->batch)
+    return machine_batch_flush(m);
+  return NO_ERR;
+}
+
+// publish the pending batched setpoints, if any, in a single message
+ccnc_error_t machine_batch_flush(machine_t *m) {
+  assert(m && m->mqt);
+  int rc;
+  if (m->batch_count == 0)
+    return NO_ERR;
+  if (!m->binary)
+    m->batch_buffer[m->batch_len++] = ']';
+  rc = mosquitto_publish(m->mqt, NULL, m->pub_topic, (int)m->batch_len,
+                         m->batch_buffer, 0, 0);
+  m->batch_len = m->batch_count = 0;
   if (rc != MOSQ_ERR_SUCCESS) {
-    eprintf("(code: %d) Could not send message %s\n", rc, m->msg_buffer);
+    eprintf("(code: %d) Could not send setpoint batch\n", rc);
     return MQTT_ERR;
   }
-  mosquitto_loop(m->mqt, 1, 1);
   return NO_ERR;
 }
 
@@ -316,13 +552,11 @@ ccnc_error_t machine_listen_stop(machine_t *m) {
 // Disconnect from MQTT broker and stop network operations
 void machine_disconnect(machine_t *m) {
   assert(m && m->mqt);
-  // Wait for network ops to be completed
-  while (mosquitto_want_write(m->mqt)) {
-    mosquitto_loop(m->mqt, 1, 1);
-    usleep(10000); // avoid consuming 100% of a CPU core for nothing
-  }
+  // The disconnect packet is queued after the pending messages: the network
+  // thread sends them all, then exits
   mosquitto_disconnect(m->mqt);
-  m->connecting = 1;
+  mosquitto_loop_stop(m->mqt, false);
+  atomic_store(&m->connecting, 1);
 }
 
 /*
@@ -346,41 +580,141 @@ static void on_connect(struct mosquitto *mqtt, void *obj, int rc) {
     eprintf("Connection error");
     exit(EXIT_FAILURE);
   }
-  m->connecting = 0;
+  atomic_store(&m->connecting, 0);
 }
 
 // Deal with messages coming on topic m->sub_topic, e.g. "c-cnc/status/#"
 // Typ. # can be either "error" or "position"
+// Runs on the network thread: feedback is published under a seqlock
 static void on_message(struct mosquitto *mqtt, void *obj,
                        const struct mosquitto_message *msg) {
   machine_t *m = (machine_t *)obj;
+  point_t pos;
+  data_t err;
   mosquitto_message_copy(m->msg, msg);
   // get last component of topic:
   char *subtopic = strrchr(msg->topic, '/') + 1;
-  if (strcmp(subtopic, "error") == 0) {
-    m->error = atof(msg->payload);
+  if (m->binary) {
+    if (strcmp(subtopic, "error") == 0 && msg->payloadlen == 8) {
+      err = get_f64(msg->payload);
+      feedback_write(m, NULL, &err);
+    } else if (strcmp(subtopic, "position") == 0 && msg->payloadlen == 24) {
+      point_set_xyz(&pos, get_f64(msg->payload),
+                    get_f64((unsigned char *)msg->payload + 8),
+                    get_f64((unsigned char *)msg->payload + 16));
+      feedback_write(m, &pos, NULL);
+    } else {
+      eprintf("Got unexpected binary message on %s (%d bytes)\n", msg->topic,
+              msg->payloadlen);
+    }
+  } else if (strcmp(subtopic, "error") == 0) {
+    err = atof(msg->payload);
+    feedback_write(m, NULL, &err);
   } else if (strcmp(subtopic, "position") == 0) {
     char *nxt = msg->payload;
-    point_set_x(m->position, strtod(nxt, &nxt));
-    point_set_y(m->position, strtod(nxt + 1, &nxt));
-    point_set_z(m->position, strtod(nxt + 1, &nxt));
+    point_set_x(&pos, strtod(nxt, &nxt));
+    point_set_y(&pos, strtod(nxt + 1, &nxt));
+    point_set_z(&pos, strtod(nxt + 1, &nxt));
+    feedback_write(m, &pos, NULL);
   } else {
     eprintf("Got unexpected subtopic %s\n", msg->topic);
   }
 }
 
-// Reconnect to the broker in case of an unexpected disconnection
-// When the disconnection is unexpected, the reason code is non-zero
+// When the disconnection is unexpected, the reason code is non-zero; the
+// network thread then reconnects by itself
 static void on_disconnect(struct mosquitto *m, void *ud, int reason) {
-  int rc = 0;
   if (reason) {
-    wprintf("Unexpected disconnection, reconnecting...");
-    rc = mosquitto_reconnect(m);
-    if (rc != MOSQ_ERR_SUCCESS)
-      eprintf("\n(code %d) Could not reconnect to broker\n", rc);
-    else
-      fprintf(stderr, "OK\n");
+    wprintf("Unexpected disconnection, reconnecting...\n");
+  }
+}
+
+// Seqlock writer (there is only one: the network thread); either pos or
+// error may be NULL, for they arrive in separate messages
+static void feedback_write(machine_t *m, point_t const *pos,
+                           data_t const *error) {
+  feedback_t *f = &m->feedback;
+  struct timespec now;
+  unsigned int s = atomic_load_explicit(&f->seq, memory_order_relaxed);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  atomic_store_explicit(&f->seq, s + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  if (pos) {
+    atomic_store_explicit(&f->x, point_x(pos), memory_order_relaxed);
+    atomic_store_explicit(&f->y, point_y(pos), memory_order_relaxed);
+    atomic_store_explicit(&f->z, point_z(pos), memory_order_relaxed);
   }
+  if (error)
+    atomic_store_explicit(&f->error, *error, memory_order_relaxed);
+  atomic_store_explicit(&f->timestamp,
+                        now.tv_sec * 1000000000ULL + now.tv_nsec,
+                        memory_order_relaxed);
+  atomic_store_explicit(&f->seq, s + 2, memory_order_release);
+}
+
+// Byte order conversion is a no-op on little endian hosts
+static void put_u32(unsigned char *buf, uint32_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  memcpy(buf, &v, sizeof(v));
+}
+
+static void put_u64(unsigned char *buf, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  memcpy(buf, &v, sizeof(v));
+}
+
+static void put_f64(unsigned char *buf, double v) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof(u));
+  put_u64(buf, u);
+}
+
+static double get_f64(unsigned char const *buf) {
+  uint64_t u;
+  double v;
+  memcpy(&u, buf, sizeof(u));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  u = __builtin_bswap64(u);
+#endif
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+// Encode the setpoint sp (workpiece offset added) into buf, returning the
+// number of bytes. In JSON, the timestamp ns is only written when non-zero,
+// i.e. in batches, as seconds since the Unix epoch
+static size_t encode_setpoint(machine_t const *m, unsigned char *buf,
+                              point_t const *sp, uint32_t flags, uint32_t seq,
+                              uint64_t ns) {
+  data_t x = point_x(sp) + point_x(&m->offset);
+  data_t y = point_y(sp) + point_y(&m->offset);
+  data_t z = point_z(sp) + point_z(&m->offset);
+  int len;
+  if (m->binary) {
+    // fixed size binary record (see machine.h)
+    put_f64(buf, x);
+    put_f64(buf + 8, y);
+    put_f64(buf + 16, z);
+    put_u32(buf + 24, flags);
+    put_u32(buf + 28, seq);
+    put_u64(buf + 32, ns);
+    return MACHINE_SETPOINT_SIZE;
+  }
+  // a setpoint description in JSON like this:
+  // {"x":1.1,"y":23.0,"z":123.0,"rapid":1}
+  if (ns)
+    len = snprintf((char *)buf, MACHINE_SETPOINT_JSON,
+                   "{\"x\":%f,\"y\":%f,\"z\":%f,\"rapid\":%d,\"t\":%.6f}", x,
+                   y, z, flags & MACHINE_RAPID, ns / 1E9);
+  else
+    len = snprintf((char *)buf, MACHINE_SETPOINT_JSON,
+                   "{\"x\":%f,\"y\":%f,\"z\":%f,\"rapid\":%d}", x, y, z,
+                   flags & MACHINE_RAPID);
+  return len < MACHINE_SETPOINT_JSON ? len : MACHINE_SETPOINT_JSON - 1;
 }
 
 /*
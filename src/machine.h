@@ -24,6 +24,33 @@
 
 typedef struct machine machine_t;
 
+// Setpoint payloads with [MQTT]:payload = "binary" (little endian):
+//    0 x, y, z (3 float64, mm, workpiece offset included)
+//   24 flags (uint32, MACHINE_RAPID | MACHINE_BATCHED)
+//   28 sequence number (uint32, one per message)
+//   32 timestamp (uint64, ns since the Unix epoch)
+// With [MQTT]:batch > 1, interpolated setpoints are sent [MQTT]:batch at a
+// time, one batch ahead of execution: a binary message holds that many
+// records, with the MACHINE_BATCHED flag and the time each setpoint is due
+// as timestamp; a JSON message is an array of setpoint objects with an
+// extra "t" field (due time, s since the epoch). The machine buffers them
+// and plays one per sampling time.
+// Status payloads are then float64 too: x, y, z on <sub_topic>/position and
+// the error on <sub_topic>/error. The format in use ("json" or "binary") is
+// published as a retained message on <pub_topic>/format
+#define MACHINE_SETPOINT_SIZE 40
+#define MACHINE_RAPID 1
+#define MACHINE_BATCHED 2
+#define MACHINE_BATCH_MAX 256
+
+// Consistent snapshot of the machine feedback
+typedef struct {
+  point_t position;   // last position received (mm)
+  data_t error;       // last positioning error received (mm)
+  uint64_t timestamp; // time of the last message (ns, CLOCK_MONOTONIC)
+  uint32_t seq;       // messages received so far (0: none yet)
+} machine_feedback_t;
+
 /*
   _____                 _   _
  |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
@@ -39,17 +66,39 @@ void machine_free(machine_t *m);
 
 /* ACCESSORS ******************************************************************/
 data_t machine_A(machine_t const *m);
+// Max jerk: 0 for trapezoidal profiles, otherwise jerk-limited (S-curve)
+data_t machine_J(machine_t const *m);
 data_t machine_tq(machine_t const *m);
 data_t machine_max_error(machine_t const *m);
 data_t machine_error(machine_t const *m);
 data_t machine_fmax(machine_t const *m);
 data_t machine_rt_pacing(machine_t const *m);
+int machine_rt_priority(machine_t const *m);
+int machine_rt_cpu(machine_t const *m);
+int machine_rt_lock(machine_t const *m);
 point_t *machine_zero(machine_t const *m);
 point_t *machine_setpoint(machine_t const *m);
+// Per-axis max acceleration and feedrate (mm/min), projected by the planner
+// onto the direction of each block
+point_t *machine_axis_A(machine_t const *m);
+point_t *machine_axis_fmax(machine_t const *m);
 point_t *machine_position(machine_t const *m);
 int machine_connecting(machine_t const *m);
+int machine_lookahead(machine_t const *m);
+int machine_stream(machine_t const *m);
+int machine_threads(machine_t const *m);
+int machine_cache(machine_t const *m);
+int machine_queue(machine_t const *m);
+int machine_continuous(machine_t const *m);
+char const *machine_log_format(machine_t const *m);
+int machine_progress(machine_t const *m);
+int machine_batch(machine_t const *m);
 
 /* METHODS ********************************************************************/
+// Copies the feedback received so far into fb, without locking: the network
+// thread is never waited for, and position, error and timestamp are always
+// from the same update
+void machine_feedback(machine_t const *m, machine_feedback_t *fb);
 void machine_print_params(machine_t const *m, FILE *out);
 
 /* MQTT related */
@@ -60,6 +109,9 @@ typedef void (*machine_on_message)(struct mosquitto *, void *,
 
 ccnc_error_t machine_connect(machine_t *m, machine_on_message callback);
 ccnc_error_t machine_sync(machine_t *m, int rapid);
+ccnc_error_t machine_batch_push(machine_t *m, point_t const *sp, data_t delay,
+                                int rapid);
+ccnc_error_t machine_batch_flush(machine_t *m);
 ccnc_error_t machine_listen_start(machine_t *m);
 ccnc_error_t machine_listen_stop(machine_t *m);
 void machine_disconnect(machine_t *m);
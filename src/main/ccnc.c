@@ -9,18 +9,85 @@
 
 #include "../defines.h"
 #include "../fsm.h"
+#include "../latency.h"
 #include <sys/time.h>
 #include <signal.h>
 #include <sched.h>
 #include <unistd.h>
 #include <syslog.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <time.h>
+#endif
 
 #define INI_FILE "machine.ini"
 
 void handler(int signal) {}
 
+#ifdef __linux__
+// Set by SIGUSR1, the main loop prints the latency statistics:
+// kill -USR1 $(pgrep ccnc)
+static volatile sig_atomic_t latency_request = 0;
+static void latency_handler(int signal) { latency_request = 1; }
+#endif
+
+#ifdef __linux__
+// Real-time setup of the calling thread: CPU affinity, SCHED_FIFO priority
+// and memory locking, as configured in the INI file. Failures are not fatal:
+// the loop keeps running with the default settings. Called once the init
+// state has started the helper threads, which keep the default settings
+static void rt_setup(machine_t const *m) {
+  if (machine_rt_cpu(m) >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(machine_rt_cpu(m), &set);
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+      wprintf("Could not pin the main loop to CPU %d\n", machine_rt_cpu(m));
+    }
+  }
+  if (machine_rt_priority(m) > 0) {
+    struct sched_param sp = {.sched_priority = machine_rt_priority(m)};
+    if (sched_setscheduler(0, SCHED_FIFO, &sp)) {
+      wprintf("Could not set SCHED_FIFO priority %d\n", sp.sched_priority);
+    }
+  }
+  if (machine_rt_lock(m) && mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    wprintf("Could not lock memory pages\n");
+  }
+}
+
+// Adds ns nanoseconds to t
+static void timespec_add(struct timespec *t, long ns) {
+  t->tv_nsec += ns;
+  while (t->tv_nsec >= 1000000000L) {
+    t->tv_nsec -= 1000000000L;
+    t->tv_sec++;
+  }
+}
+
+// a - b in nanoseconds
+static long long timespec_diff(struct timespec const *a,
+                               struct timespec const *b) {
+  return (a->tv_sec - b->tv_sec) * 1000000000LL + (a->tv_nsec - b->tv_nsec);
+}
+
+// Prints the wake-up jitter, the execution time of the states that ran and
+// the age of the machine feedback they used
+static void latency_dump(latency_t *jitter, latency_t *exec[],
+                         latency_t *feedback) {
+  ccnc_state_t s;
+  fprintf(stderr, BGRN "Main loop timing statistics:\n" CRESET);
+  latency_print(jitter, stderr, 1);
+  for (s = 0; s < CCNC_NUM_STATES; s++) {
+    if (latency_count(exec[s]) > 0)
+      latency_print(exec[s], stderr, 0);
+  }
+  if (latency_count(feedback) > 0)
+    latency_print(feedback, stderr, 0);
+}
+#endif
+
 int main(int argc, char const **argv) {
-  struct itimerval itv;
   // create and populate the FSM data structure
   ccnc_state_data_t state_data = {
     .ini_file = INI_FILE,
@@ -29,49 +96,131 @@ int main(int argc, char const **argv) {
     .program = NULL
   };
   ccnc_state_t cur_state = CCNC_STATE_INIT;
-  data_t rt_pacing = machine_rt_pacing(state_data.machine);
-  // timing values (note that machine.ini has values in seconds, so we need to 
-  // convert to microseconds)
-  useconds_t dt = machine_tq(state_data.machine) * 1E6 * rt_pacing;
-  useconds_t dt_max = dt * 10;
+  data_t rt_pacing;
 
   if (!state_data.machine) {
     eprintf("Error initializeng the machine object\n");
     exit(EXIT_FAILURE);
   }
-
-  itv.it_interval.tv_sec = 0.0;
-  itv.it_interval.tv_usec = dt;
-  itv.it_value.tv_sec = 0.0;
-  itv.it_value.tv_usec = dt;
-
-  // define and empty function as signal handler
-  signal(SIGALRM, handler);
-  // prepare the timer
-  if (setitimer(ITIMER_REAL, &itv, NULL)) {
-    eprintf("Could not set the timer\n");
-    exit(EXIT_FAILURE);
-  }
+  rt_pacing = machine_rt_pacing(state_data.machine);
 
   // Setup system logging
-  // too see the logs, run the following in a separate terminal WHILE the 
+  // too see the logs, run the following in a separate terminal WHILE the
   // program is running:
   // Mac:       log stream --predicate 'process == "ccnc"' --info --style syslog
   // Linux/WSL: tail -f /var/log/syslog | grep CCNC
   openlog("CCNC v" VERSION, LOG_PID, LOG_USER);
   syslog(LOG_INFO, "[FSM] Starting CCNC --->");
 
-  // Main loop
-  do {
-    cur_state = ccnc_run_state(cur_state, &state_data);
-    if (usleep(dt_max) == 0) {
-      wprintf("Did not complete the loop iteration in less than %d us\n", dt_max);
+#ifdef __linux__
+  // Main loop, run at absolute deadlines: the period does not drift with
+  // the loop execution time nor with the wake-up latency. When an iteration
+  // ends after the next deadline, the missed periods are counted as overruns
+  // and skipped. Init and idle are not real-time (parsing, waiting for a
+  // key, filling the trajectory queue): after them, the deadlines start over
+  // from the current time, and nothing is counted.
+  // Every iteration is timestamped: the wake-up jitter (delay after the
+  // deadline) and the execution time of each state are collected in
+  // histograms, printed on exit and on SIGUSR1
+  {
+    struct timespec deadline, now, start;
+    long period = machine_tq(state_data.machine) * 1E9 * rt_pacing;
+    long long late, late_max = 0;
+    size_t loops = 0, overruns = 0;
+    ccnc_state_t s;
+    latency_t *jitter = latency_new("jitter");
+    latency_t *exec[CCNC_NUM_STATES];
+
+    state_data.feedback_age = latency_new("feedback_age");
+    for (s = 0; s < CCNC_NUM_STATES; s++) {
+      exec[s] = latency_new(ccnc_state_names[s]);
+      if (!jitter || !exec[s] || !state_data.feedback_age) {
+        eprintf("Could not allocate the latency histograms\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    signal(SIGUSR1, latency_handler);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    start = deadline;
+    do {
+      s = cur_state;
+      cur_state = ccnc_run_state(cur_state, &state_data);
+      loops++;
+      timespec_add(&deadline, period);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      latency_record(exec[s], timespec_diff(&now, &start));
+      if (s == CCNC_STATE_INIT)
+        rt_setup(state_data.machine);
+      if (s == CCNC_STATE_INIT || s == CCNC_STATE_IDLE) {
+        deadline = now;
+      } else if ((late = timespec_diff(&now, &deadline)) > 0) {
+        late_max = late > late_max ? late : late_max;
+        while (timespec_diff(&now, &deadline) >= 0) {
+          timespec_add(&deadline, period);
+          overruns++;
+        }
+      }
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                             NULL) == EINTR)
+        ;
+      // the wake-up time is also the start of the next iteration
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      latency_record(jitter, timespec_diff(&start, &deadline));
+      if (latency_request) {
+        latency_request = 0;
+        latency_dump(jitter, exec, state_data.feedback_age);
+      }
+    } while (cur_state != CCNC_STATE_STOP);
+    if (overruns > 0) {
+      fprintf(stderr,
+              BYEL "Missed %zu deadlines in %zu loops (max %.3f ms late)\n"
+                   CRESET, overruns, loops, late_max / 1E6);
+      syslog(LOG_WARNING, "[FSM] Missed %zu deadlines in %zu loops", overruns,
+             loops);
+    }
+    latency_dump(jitter, exec, state_data.feedback_age);
+    syslog(LOG_INFO, "[FSM] Wake-up jitter p99 %.1f us, max %.1f us",
+           latency_percentile(jitter, 0.99) / 1E3, latency_max(jitter) / 1E3);
+    latency_free(jitter);
+    latency_free(state_data.feedback_age);
+    for (s = 0; s < CCNC_NUM_STATES; s++)
+      latency_free(exec[s]);
+  }
+#else
+  // Without clock_nanosleep, the loop is paced by an interval timer
+  {
+    struct itimerval itv;
+    // timing values (note that machine.ini has values in seconds, so we need
+    // to convert to microseconds)
+    useconds_t dt = machine_tq(state_data.machine) * 1E6 * rt_pacing;
+    useconds_t dt_max = dt * 10;
+
+    itv.it_interval.tv_sec = 0.0;
+    itv.it_interval.tv_usec = dt;
+    itv.it_value.tv_sec = 0.0;
+    itv.it_value.tv_usec = dt;
+
+    // define and empty function as signal handler
+    signal(SIGALRM, handler);
+    // prepare the timer
+    if (setitimer(ITIMER_REAL, &itv, NULL)) {
+      eprintf("Could not set the timer\n");
+      exit(EXIT_FAILURE);
     }
-  } while (cur_state != CCNC_STATE_STOP);
+
+    do {
+      cur_state = ccnc_run_state(cur_state, &state_data);
+      if (usleep(dt_max) == 0) {
+        wprintf("Did not complete the loop iteration in less than %d us\n",
+                dt_max);
+      }
+    } while (cur_state != CCNC_STATE_STOP);
+  }
+#endif
   // run the final state once more
   ccnc_run_state(cur_state,  &state_data);
 
   syslog(LOG_INFO, "[FSM] Stopping CCNC <---");
 
-  return 0;
-}
\ No newline at end of file
+  return state_data.error == NO_ERR ? 0 : EXIT_FAILURE;
+}
@@ -0,0 +1,442 @@
+/*
+   ____ ____ _   _  ____   _                     _
+  / ___/ ___| \ | |/ ___| | |__   ___ _ __   ___| |__
+ | |  | |   |  \| | |     | '_ \ / _ \ '_ \ / __| '_ \
+ | |__| |___| |\  | |___  | |_) |  __/ | | | (__| | | |
+  \____\____|_| \_|\____| |_.__/ \___|_| |_|\___|_| |_|
+
+* Benchmarks for the C-CNC library. Usage:
+*   ccnc_bench gen <n>                 write a n-blocks G-code program to stdout
+*   ccnc_bench parse <G-code> <INI>    parse time, throughput, peak memory
+*   ccnc_bench interp <G-code> <INI>   interpolation ticks per second
+*   ccnc_bench compiled <G-code> <INI> same, on the compiled program
+*   ccnc_bench lambda <G-code> <INI>   profile evaluation, vs. the closed form
+*                                      (trapezoidal profiles: [C-CNC]:J = 0)
+*   ccnc_bench step <G-code> <INI>     arc stepping, vs. block_interpolate_to()
+*   ccnc_bench time <G-code> <INI>     interpolated motion time ([C-CNC]:tq,
+*                                      A, J and continuous matter)
+*   ccnc_bench sync <INI>              setpoint publishing cost and size
+*/
+
+#include "../defines.h"
+#include "../program.h"
+#include "../compiled.h"
+#include "../trajectory.h"
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Monotonic time in seconds
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+// Peak resident set size in MB
+static double peak_rss() {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+  return ru.ru_maxrss / 1048576.0; // bytes
+#else
+  return ru.ru_maxrss / 1024.0; // kilobytes
+#endif
+}
+
+// A contour made of short segments and arcs, like CAM surfacing programs
+static int bench_gen(size_t n) {
+  size_t i;
+  data_t x = 0, y = 0;
+  printf("N0 G00 X0 Y0 Z10\n");
+  printf("N1 G01 Z0 F2000 S5000 T1\n");
+  for (i = 2; i < n; i++) {
+    if (i % 10 == 0) {
+      printf("N%zu G02 X%.3f Y%.3f I0.5 J0\n", i, x + 1, y);
+      x += 1;
+    } else {
+      x += 0.1 * (i % 7);
+      y = (i % 2) ? y + 0.25 : y - 0.2;
+      printf("N%zu G01 X%.3f Y%.3f\n", i, x, y);
+    }
+  }
+  return 0;
+}
+
+static int bench_parse(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  double t0, t1, t2;
+  struct stat st;
+  if (stat(gcode, &st) != 0) {
+    eprintf("Cannot open the file at %s\n", gcode);
+    return EXIT_FAILURE;
+  }
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p) {
+    eprintf("Error creating a program\n");
+    return EXIT_FAILURE;
+  }
+  t0 = now();
+  if (program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    return EXIT_FAILURE;
+  }
+  t1 = now();
+  program_free(p);
+  t2 = now();
+  printf("parse: %.3f s (%.1f MB/s), free: %.3f s, peak RSS: %.1f MB\n",
+         t1 - t0, st.st_size / 1048576.0 / (t1 - t0), t2 - t1, peak_rss());
+  machine_free(m);
+  return 0;
+}
+
+// Interpolates all the blocks over and over for at least one second
+static int bench_interp(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  block_t *b = NULL;
+  point_t *pos = NULL;
+  data_t t, tq, dt, lambda, v, sum = 0;
+  size_t ticks = 0;
+  double t0, t1;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    return EXIT_FAILURE;
+  }
+  tq = machine_tq(m);
+  t0 = t1 = now();
+  while (t1 - t0 < 1.0) {
+    program_reset(p);
+    while ((b = program_next(p))) {
+      if (block_type(b) == RAPID || block_type(b) == NO_MOTION)
+        continue;
+      dt = block_dt(b);
+      for (t = 0; t - dt < tq / 10.0; t += tq, ticks++) {
+        pos = block_interpolate_t(b, t, &lambda, &v);
+        sum += point_x(pos) + point_y(pos) + point_z(pos);
+      }
+    }
+    t1 = now();
+  }
+  printf("interp: %zu ticks in %.3f s, %.3g ticks/s (checksum %g)\n", ticks,
+         t1 - t0, ticks / (t1 - t0), sum);
+  program_free(p);
+  machine_free(m);
+  return 0;
+}
+
+// Same as bench_interp, but on the compiled program
+static int bench_compiled(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  compiled_t *c = NULL;
+  point_t pos;
+  data_t t, tq, dt, v, sum = 0;
+  size_t i, n, ticks = 0;
+  double t0, t1;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p || program_parse(p, m) != NO_ERR || !(c = compiled_new(p))) {
+    eprintf("Error compiling the program\n");
+    return EXIT_FAILURE;
+  }
+  tq = machine_tq(m);
+  n = compiled_length(c);
+  t0 = t1 = now();
+  while (t1 - t0 < 1.0) {
+    for (i = 0; i < n; i++) {
+      if (compiled_type(c, i) == RAPID || compiled_type(c, i) == NO_MOTION)
+        continue;
+      dt = compiled_dt(c, i);
+      for (t = 0; t - dt < tq / 10.0; t += tq, ticks++) {
+        compiled_interpolate(c, i, t, &v, &pos);
+        sum += point_x(&pos) + point_y(&pos) + point_z(&pos);
+      }
+    }
+    t1 = now();
+  }
+  printf("compiled: %zu ticks in %.3f s, %.3g ticks/s (checksum %g)\n", ticks,
+         t1 - t0, ticks / (t1 - t0), sum);
+  compiled_free(c);
+  program_free(p);
+  machine_free(m);
+  return 0;
+}
+
+// The velocity profile evaluated in closed form, as it was before the
+// per-phase polynomials of block_poly_t: the reference for bench_lambda
+static data_t lambda_closed_form(block_profile_t const *prof, data_t t,
+                                 data_t *s) {
+  data_t r;
+  data_t dt_1 = prof->dt_1;
+  data_t dt_2 = prof->dt_2;
+  data_t dt_m = prof->dt_m;
+  data_t a = prof->a;
+  data_t d = prof->d;
+  data_t f = prof->f;
+  data_t fs = prof->fs;
+
+  if (t < 0) {
+    r = 0.0;
+    *s = fs;
+  } else if (t < dt_1) { // acceleration
+    r = fs * t + a * pow(t, 2) / 2.0;
+    *s = fs + a * t;
+  } else if (t < dt_1 + dt_m) { // maintenance
+    r = (fs + f) * dt_1 / 2.0 + f * (t - dt_1);
+    *s = f;
+  } else if (t < dt_1 + dt_m + dt_2) { // deceleration
+    data_t t_2 = dt_1 + dt_m;
+    r = (fs + f) * dt_1 / 2.0 + f * (dt_m + t - t_2) +
+        d / 2.0 * (pow(t, 2) + pow(t_2, 2)) - d * t * t_2;
+    *s = f + d * (t - t_2);
+  } else {
+    r = prof->l;
+    *s = prof->fe;
+  }
+
+  r /= prof->l;
+  *s *= 60; // convert to mm/min
+  return r;
+}
+
+// Evaluates the profiles of all the interpolated blocks at every tick, for
+// at least one second with each method; reports the max differences
+static int bench_lambda(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  block_t *b = NULL;
+  block_profile_t *prof = NULL;
+  data_t t, tq, l1, l2, v1, v2, sum1 = 0, sum2 = 0, err_l = 0, err_v = 0;
+  size_t i, n = 0, ticks;
+  double t0, t1, rate1, rate2;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    return EXIT_FAILURE;
+  }
+  prof = malloc(program_length(p) * sizeof(*prof));
+  if (!prof) {
+    eprintf("Could not allocate memory\n");
+    return EXIT_FAILURE;
+  }
+  program_reset(p);
+  while ((b = program_next(p))) {
+    if ((block_type(b) == LINE || block_type(b) == CWA ||
+         block_type(b) == CCWA) && block_length(b) > 0)
+      prof[n++] = *block_profile(b);
+  }
+  tq = machine_tq(m);
+
+  // accuracy
+  for (i = 0; i < n; i++) {
+    for (t = 0; t - prof[i].dt < tq / 10.0; t += tq) {
+      l1 = lambda_closed_form(&prof[i], t, &v1);
+      l2 = block_poly_lambda(&prof[i].poly, t, &v2);
+      err_l = fmax(err_l, fabs(l1 - l2));
+      err_v = fmax(err_v, fabs(v1 - v2));
+    }
+  }
+
+  // speed
+  for (ticks = 0, t0 = t1 = now(); t1 - t0 < 1.0; t1 = now()) {
+    for (i = 0; i < n; i++) {
+      for (t = 0; t - prof[i].dt < tq / 10.0; t += tq, ticks++)
+        sum1 += lambda_closed_form(&prof[i], t, &v1) + v1;
+    }
+  }
+  rate1 = ticks / (t1 - t0);
+  for (ticks = 0, t0 = t1 = now(); t1 - t0 < 1.0; t1 = now()) {
+    for (i = 0; i < n; i++) {
+      for (t = 0; t - prof[i].dt < tq / 10.0; t += tq, ticks++)
+        sum2 += block_poly_lambda(&prof[i].poly, t, &v2) + v2;
+    }
+  }
+  rate2 = ticks / (t1 - t0);
+
+  printf("lambda: closed form %.3g ticks/s, polynomials %.3g ticks/s "
+         "(%.2fx)\n", rate1, rate2, rate2 / rate1);
+  printf("lambda: max difference %.3g (lambda), %.3g mm/min (speed), "
+         "checksums %g %g\n", err_l, err_v, sum1, sum2);
+  free(prof);
+  program_free(p);
+  machine_free(m);
+  return 0;
+}
+
+// Walks every arc in BENCH_STEPS steps, for at least one second with each
+// method: block_step_next() and block_interpolate_to() at the same lambdas
+#define BENCH_STEPS 1000
+static int bench_step(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  block_t *b = NULL;
+  block_step_t it;
+  point_t pos;
+  data_t sum1 = 0, sum2 = 0;
+  size_t i, points;
+  double t0, t1, rate1, rate2;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    return EXIT_FAILURE;
+  }
+  for (points = 0, t0 = t1 = now(); t1 - t0 < 1.0; t1 = now()) {
+    program_reset(p);
+    while ((b = program_next(p))) {
+      if (block_type(b) != CWA && block_type(b) != CCWA)
+        continue;
+      for (i = 0; i <= BENCH_STEPS; i++, points++) {
+        block_interpolate_to(b, (data_t)i / BENCH_STEPS, &pos);
+        sum1 += point_x(&pos) + point_y(&pos);
+      }
+    }
+  }
+  if (points == 0) {
+    eprintf("No arcs in %s\n", gcode);
+    return EXIT_FAILURE;
+  }
+  rate1 = points / (t1 - t0);
+  for (points = 0, t0 = t1 = now(); t1 - t0 < 1.0; t1 = now()) {
+    program_reset(p);
+    while ((b = program_next(p))) {
+      if (block_type(b) != CWA && block_type(b) != CCWA)
+        continue;
+      block_step_init(&it, b, BENCH_STEPS);
+      for (; block_step_next(&it, &pos); points++)
+        sum2 += point_x(&pos) + point_y(&pos);
+    }
+  }
+  rate2 = points / (t1 - t0);
+  printf("step: cos/sin %.3g points/s, stepping %.3g points/s (%.2fx), "
+         "checksums %g %g\n", rate1, rate2, rate2 / rate1, sum1, sum2);
+  program_free(p);
+  machine_free(m);
+  return 0;
+}
+
+// Drains the trajectory of the program, as fast as possible, counting the
+// setpoints of interpolated blocks: each one takes a tick of machine time
+static int bench_time(char const *gcode, char const *ini) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  trajectory_t *t = NULL;
+  setpoint_t sp;
+  size_t ticks = 0, blocks = 0;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  p = program_new(gcode);
+  if (!p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    return EXIT_FAILURE;
+  }
+  t = trajectory_new(p, m);
+  if (!t || trajectory_start(t) != NO_ERR) {
+    eprintf("Error starting the trajectory\n");
+    return EXIT_FAILURE;
+  }
+  do {
+    if (!trajectory_wait(t) || !trajectory_pop(t, &sp))
+      break;
+    if (sp.type != NO_MOTION) {
+      ticks++;
+      blocks += (sp.flags & SETPOINT_FIRST) != 0;
+    }
+  } while (!(sp.flags & SETPOINT_END));
+  printf("time: %zu interpolated blocks, %zu ticks, %.3f s (continuous: %d)\n",
+         blocks, ticks, ticks * machine_tq(m), machine_continuous(m));
+  trajectory_free(t);
+  program_free(p);
+  machine_free(m);
+  return 0;
+}
+
+// Time machine_sync (or machine_batch_push, with [MQTT]:batch > 1) with the
+// [MQTT]:payload format selected in the INI file
+static int bench_sync(char const *ini) {
+  machine_t *m = NULL;
+  size_t n = 0;
+  double t0, t1;
+  m = machine_new(ini);
+  if (!m) {
+    eprintf("Error in INI file\n");
+    return EXIT_FAILURE;
+  }
+  if (machine_connect(m, NULL) != NO_ERR) {
+    machine_free(m);
+    return EXIT_FAILURE;
+  }
+  t0 = t1 = now();
+  while (t1 - t0 < 1.0) {
+    point_set_xyz(machine_setpoint(m), n * 1E-3, -12.345678, 100.0 + n * 1E-6);
+    if (machine_batch(m) > 1) {
+      if (machine_batch_push(m, machine_setpoint(m),
+                             n % machine_batch(m) * machine_tq(m),
+                             n % 2) != NO_ERR)
+        break;
+    } else if (machine_sync(m, n % 2) != NO_ERR) {
+      break;
+    }
+    if (++n % 1024 == 0)
+      t1 = now();
+  }
+  printf("sync: %zu setpoints in %.3f s, %.0f ns each (batch %d)\n", n,
+         t1 - t0, (t1 - t0) / n * 1E9, machine_batch(m));
+  machine_disconnect(m);
+  machine_free(m);
+  return 0;
+}
+
+int main(int argc, char const **argv) {
+  if (argc == 3 && strcmp(argv[1], "gen") == 0) {
+    return bench_gen(atol(argv[2]));
+  } else if (argc == 4 && strcmp(argv[1], "parse") == 0) {
+    return bench_parse(argv[2], argv[3]);
+  } else if (argc == 4 && strcmp(argv[1], "interp") == 0) {
+    return bench_interp(argv[2], argv[3]);
+  } else if (argc == 4 && strcmp(argv[1], "compiled") == 0) {
+    return bench_compiled(argv[2], argv[3]);
+  } else if (argc == 4 && strcmp(argv[1], "time") == 0) {
+    return bench_time(argv[2], argv[3]);
+  } else if (argc == 4 && strcmp(argv[1], "step") == 0) {
+    return bench_step(argv[2], argv[3]);
+  } else if (argc == 4 && strcmp(argv[1], "lambda") == 0) {
+    return bench_lambda(argv[2], argv[3]);
+  } else if (argc == 3 && strcmp(argv[1], "sync") == 0) {
+    return bench_sync(argv[2]);
+  }
+  eprintf("Usage: %s gen <n> | "
+          "parse|interp|compiled|lambda|step|time <G-code> <INI> | "
+          "sync <INI>\n",
+          argv[0]);
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+/*
+   ____ ____ _   _  ____       _
+  / ___/ ___| \ | |/ ___|   __| |_   _ _ __ ___  _ __
+ | |  | |   |  \| | |      / _` | | | | '_ ` _ \| '_ \
+ | |__| |___| |\  | |___  | (_| | |_| | | | | | | |_) |
+  \____\____|_| \_|\____|  \__,_|\__,_|_| |_| |_| .__/
+                                                |_|
+
+* Converts a binary trajectory table (log_format = "binary") back to text.
+* Usage:
+*   ccnc_dump <file>       the same table as log_format = "text"
+*   ccnc_dump -c <file>    CSV, with a single header line
+*/
+
+#include "../defines.h"
+#include "../logger.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Prints the column names: "#n type ..." as a text table, "n,type,..." as CSV
+static void dump_header(logger_field_t const *fields, size_t n, int csv) {
+  size_t k;
+  for (k = 0; k < n; k++) {
+    printf("%s%s", k ? (csv ? "," : " ") : (csv ? "" : "#"), fields[k].name);
+  }
+  printf("\n");
+}
+
+// The table is read in place from the mapped file
+static int dump(char const *path, int csv) {
+  int fd = -1, header = 0;
+  struct stat st;
+  unsigned char const *map = NULL, *p, *end;
+  logger_file_t const *file = NULL;
+  logger_field_t const *fields = NULL;
+  logger_chunk_t const *chunk = NULL;
+  void const *columns[LOGGER_FIELDS];
+  size_t i, k, size;
+  data_t v;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    eprintf("Cannot open the file at %s\n", path);
+    return EXIT_FAILURE;
+  }
+  if ((size_t)st.st_size < sizeof(logger_file_t)) {
+    eprintf("%s is not a C-CNC binary log\n", path);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    eprintf("Cannot map the file at %s in memory\n", path);
+    return EXIT_FAILURE;
+  }
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+  end = map + st.st_size;
+  file = (logger_file_t const *)map;
+  if (memcmp(file->magic, LOGGER_MAGIC, sizeof(file->magic)) != 0 ||
+      file->version != LOGGER_VERSION || file->fields != LOGGER_FIELDS ||
+      sizeof(*file) + file->fields * sizeof(*fields) > (size_t)st.st_size) {
+    eprintf("%s is not a C-CNC binary log (version %d)\n", path,
+            LOGGER_VERSION);
+    munmap((void *)map, st.st_size);
+    return EXIT_FAILURE;
+  }
+  fields = (logger_field_t const *)(file + 1);
+  p = (unsigned char const *)(fields + file->fields);
+
+  while (p + sizeof(*chunk) <= end) {
+    chunk = (logger_chunk_t const *)p;
+    p += sizeof(*chunk);
+    if (chunk->rows == 0) { // start of a run
+      if (!csv || !header++)
+        dump_header(fields, file->fields, csv);
+      continue;
+    }
+    for (k = 0; k < file->fields; k++) {
+      size = logger_column_size(&fields[k], chunk->rows);
+      if (p + size > end) {
+        eprintf("Truncated chunk at offset %td\n",
+                (unsigned char const *)chunk - map);
+        munmap((void *)map, st.st_size);
+        return EXIT_FAILURE;
+      }
+      columns[k] = p;
+      p += size;
+    }
+    for (i = 0; i < chunk->rows; i++) {
+      for (k = 0; k < file->fields; k++) {
+        v = logger_column_value(&fields[k], columns[k], i);
+        if (k > 0)
+          putchar(csv ? ',' : ' ');
+        if (fields[k].decimals == 0)
+          printf("%0*ld", csv ? 0 : fields[k].width, lround(v));
+        else
+          printf("%.*f", fields[k].decimals, v);
+      }
+      putchar('\n');
+    }
+  }
+  munmap((void *)map, st.st_size);
+  return 0;
+}
+
+int main(int argc, char const **argv) {
+  if (argc == 2) {
+    return dump(argv[1], 0);
+  } else if (argc == 3 && strcmp(argv[1], "-c") == 0) {
+    return dump(argv[2], 1);
+  }
+  eprintf("Usage: %s [-c] <binary log file>\n", argv[0]);
+  return EXIT_FAILURE;
+}
@@ -19,16 +19,7 @@
 
 */
 
-// Structure representing the Point class
-typedef struct point {
-  data_t x, y, z; // coordinates
-  uint8_t m;      // bitmask
-} point_t;
-
-#define X_SET '\1'
-#define Y_SET '\2'
-#define Z_SET '\4'
-#define XYZ_SET '\7'
+// The Point class structure is defined in the header
 
 /*
   _____                 _   _
@@ -50,6 +41,16 @@ point_t *point_new() {
   return p;
 }
 
+point_t *point_new_in(arena_t *arena) {
+  assert(arena);
+  point_t *p = arena_alloc(arena, sizeof(point_t));
+  if (!p) {
+    eprintf("Error allocating memory for a point\n");
+    return NULL;
+  }
+  return p;
+}
+
 void point_free(point_t *p) {
   assert(p);
   free(p);
@@ -88,32 +89,6 @@ void point_inspect(point_t const *p, char **desc) {
   }
 }
 
-/* ACCESSORS ******************************************************************/
-
-void point_set_xyz(point_t *p, data_t x, data_t y, data_t z) {
-  assert(p);
-  p->x = x;
-  p->y = y;
-  p->z = z;
-  p->m = XYZ_SET;
-}
-
-// D.R.Y.
-#define point_accessors(axis, bitmask)                                         \
-  void point_set_##axis(point_t *p, data_t value) {                            \
-    assert(p);                                                                 \
-    p->axis = value;                                                           \
-    p->m = p->m | bitmask;                                                     \
-  }                                                                            \
-  data_t point_##axis(point_t const *p) {                                      \
-    assert(p);                                                                 \
-    return p->axis;                                                            \
-  }
-
-point_accessors(x, X_SET);
-point_accessors(y, Y_SET);
-point_accessors(z, Z_SET);
-
 /* METHODS ********************************************************************/
 
 data_t point_dist(point_t const *from, point_t const *to) {
@@ -11,6 +11,7 @@
 #define POINT_H
 
 #include "defines.h"
+#include "arena.h"
 
 /*
   ____            _                 _   _                 
@@ -21,8 +22,17 @@
                                                           
 */
 
-// Opaque structure representing the Point class
-typedef struct point point_t;
+// Structure representing the Point class. It is a value type, so that it 
+// can be embedded in other objects; use the accessors rather than the fields
+typedef struct point {
+  data_t x, y, z; // coordinates
+  uint8_t m;      // bitmask
+} point_t;
+
+#define X_SET '\1'
+#define Y_SET '\2'
+#define Z_SET '\4'
+#define XYZ_SET '\7'
 
 
 /*
@@ -36,22 +46,43 @@ typedef struct point point_t;
 
 /* LIFECYCLE ******************************************************************/
 point_t *point_new();
+// Allocates the point within an arena: it is released with the arena, so
+// it shall not be passed to point_free()
+point_t *point_new_in(arena_t *arena);
 void point_free(point_t *p);
 // Provides description of p in a nuely allocated string 
 void point_inspect(point_t const *p, char **description);
 
 
 /* ACCESSORS ******************************************************************/
-// Setters
-void point_set_x(point_t *p, data_t x);
-void point_set_y(point_t *p, data_t y);
-void point_set_z(point_t *p, data_t z);
-void point_set_xyz(point_t *p, data_t x, data_t y, data_t z);
-
-// Getters
-data_t point_x(point_t const *p);
-data_t point_y(point_t const *p);
-data_t point_z(point_t const *p);
+// Accessors are inlined, as they are used in the interpolation loop
+
+static inline void point_set_xyz(point_t *p, data_t x, data_t y, data_t z) {
+  assert(p);
+  p->x = x;
+  p->y = y;
+  p->z = z;
+  p->m = XYZ_SET;
+}
+
+// D.R.Y.
+#define point_accessors(axis, bitmask)                                         \
+  static inline void point_set_##axis(point_t *p, data_t value) {              \
+    assert(p);                                                                 \
+    p->axis = value;                                                           \
+    p->m = p->m | bitmask;                                                     \
+  }                                                                            \
+  static inline data_t point_##axis(point_t const *p) {                        \
+    assert(p);                                                                 \
+    return p->axis;                                                            \
+  }
+
+// Setters and getters
+point_accessors(x, X_SET);
+point_accessors(y, Y_SET);
+point_accessors(z, Z_SET);
+
+#undef point_accessors
 
 
 /* METHODS ********************************************************************/
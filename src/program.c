@@ -8,6 +8,14 @@
 */
 
 #include "program.h"
+#include "rt.h"
+#include <fcntl.h>
+#include <limits.h> // PATH_MAX
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/param.h> // MIN, MAX
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
   ____        __ _       _ _   _
@@ -24,8 +32,48 @@ typedef struct program {
   block_t *current;
   block_t *last;
   size_t n; // total number of G-code blocks
+  arena_t *arena; // memory for the blocks (not used when streaming)
+  char const *map; // G-code file mapped in memory (not used when streaming)
+  size_t map_len;  // length of the mapping
+  /* STREAMING SECTION */
+  machine_t const *machine; // machine used for parsing
+  size_t window;            // max blocks parsed ahead (0: no streaming)
+  pthread_t reader;         // background parser thread
+  pthread_mutex_t lock;     // protects the fields below
+  pthread_cond_t cond;      // signals new ready blocks or consumed blocks
+  block_t *ready;           // last block with a final velocity profile
+  size_t n_ready;           // number of ready blocks
+  size_t n_done;            // number of blocks returned by program_next
+  int running, eof, stop;   // reader thread state
+  ccnc_error_t error;       // reader thread result
 } program_t;
 
+// Smaller files are always parsed sequentially (bytes)
+#define PARALLEL_MIN_SIZE (1 << 20)
+
+// Program cache file: a header followed by one record per block
+#define CACHE_EXT ".ccnc"
+#define CACHE_MAGIC "CCNCPRG"
+#define CACHE_VERSION 4
+typedef struct {
+  char magic[8];        // CACHE_MAGIC
+  uint32_t version;     // CACHE_VERSION
+  uint32_t record_size; // sizeof(block_record_t)
+  uint64_t key;         // hash of G-code and machine parameters
+  uint64_t n;           // number of records
+} program_cache_t;
+
+// Work unit of a parallel parser thread
+typedef struct {
+  char const **lines;       // first char of each line
+  char const *end;          // end of the mapped file
+  block_t **blocks;         // blocks created from lines
+  size_t n;                 // number of lines
+  size_t fail;              // index of the first invalid line (n if none)
+  machine_t const *machine; // machine used for parsing
+  arena_t *arena;           // thread-local memory for the blocks
+} program_lexer_t;
+
 /*
   _____                 _   _
  |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
@@ -35,6 +83,24 @@ typedef struct program {
 
 */
 
+/* Static functions ***********************************************************/
+static void program_clear(program_t *p);
+static ccnc_error_t program_map(program_t *p);
+static ccnc_error_t program_parse_parallel(program_t *p, machine_t const *m,
+                                           size_t threads);
+static void *program_lexer(void *arg);
+static ccnc_error_t program_parse_sequential(program_t *p,
+                                             machine_t const *m);
+static uint64_t program_hash(void const *data, size_t len, uint64_t h);
+static uint64_t program_cache_key(program_t const *p, machine_t const *m);
+static ccnc_error_t program_cache_load(program_t *p, machine_t const *m,
+                                       uint64_t key);
+static void program_cache_save(program_t const *p, uint64_t key);
+static ccnc_error_t program_stream_start(program_t *p);
+static void program_stream_stop(program_t *p);
+static void *program_reader(void *arg);
+static block_t *program_stream_next(program_t *p);
+
 /* Lifecycle ******************************************************************/
 program_t *program_new(char const *filename) {
   assert(filename);
@@ -50,18 +116,17 @@ program_t *program_new(char const *filename) {
   }
   memset(p, 0, sizeof(*p));
   p->filename = strdup(filename);
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->cond, NULL);
   return p;
 }
 
 void program_free(program_t *p) {
   assert(p);
-  block_t *b, *tmp;
-  b = p->first;
-  while (b) {
-    tmp = b;
-    b = block_next(b);
-    block_free(tmp);
-  }
+  program_stream_stop(p);
+  program_clear(p);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->cond);
   free(p->filename);
   free(p);
   p = NULL;
@@ -69,7 +134,12 @@ void program_free(program_t *p) {
 
 void program_print(program_t *p, FILE *output) {
   assert(p && output);
-  block_t *b = p->first;
+  block_t *b = NULL;
+  if (p->window) {
+    fprintf(output, "Streaming program, %zu blocks window\n", p->window);
+    return;
+  }
+  b = p->first;
   while (b) {
     block_print(b, output);
     b = block_next(b);
@@ -89,58 +159,571 @@ program_getter(block_t *, first, first);
 program_getter(block_t *, current, current);
 program_getter(block_t *, last, last);
 
+ccnc_error_t program_error(program_t *p) {
+  assert(p);
+  ccnc_error_t error;
+  pthread_mutex_lock(&p->lock);
+  error = p->error;
+  pthread_mutex_unlock(&p->lock);
+  return error;
+}
+
 /* Methods ********************************************************************/
 ccnc_error_t program_parse(program_t *p, machine_t const *m) {
   assert(p && m);
+  size_t threads = 1;
+  uint64_t key = 0;
+  ccnc_error_t error = NO_ERR;
+
+  // In streaming mode, blocks are parsed by a background thread and 
+  // consumed by program_next()
+  p->machine = m;
+  if (machine_stream(m) > 0) {
+    p->window = machine_stream(m);
+    return program_stream_start(p);
+  }
+
+  // The file is mapped in memory and blocks keep a view of their line
+  if ((error = program_map(p)) != NO_ERR) {
+    return error;
+  }
+  // All the blocks are released together, so they are allocated in an arena
+  if (!p->arena && !(p->arena = arena_new(0))) {
+    return ALLOC_ERR;
+  }
+  // A program already parsed with the same parameters is loaded from cache
+  if (machine_cache(m) > 0) {
+    key = program_cache_key(p, m);
+    if (program_cache_load(p, m, key) == NO_ERR) {
+      program_reset(p);
+      return NO_ERR;
+    }
+  }
+  // Large programs are lexed by a pool of threads
+  threads = machine_threads(m) > 0 ? (size_t)machine_threads(m)
+                                   : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads > 1 && p->map_len >= PARALLEL_MIN_SIZE) {
+    error = program_parse_parallel(p, m, threads);
+  } else {
+    error = program_parse_sequential(p, m);
+  }
+  if (error == NO_ERR && machine_cache(m) > 0) {
+    program_cache_save(p, key);
+  }
+  return error;
+}
+
+ccnc_error_t program_reset(program_t *p) {
+  assert(p);
+  ccnc_error_t error = NO_ERR;
+  // a streamed program that has been (partially) executed must be parsed
+  // again from the beginning
+  if (p->window && p->n_done > 0) {
+    program_stream_stop(p);
+    program_clear(p);
+    error = program_stream_start(p);
+  }
+  p->current = NULL;
+  return error;
+}
+
+block_t *program_next(program_t *p) {
+  assert(p);
+  if (p->window) {
+    return program_stream_next(p);
+  }
+  if (p->current == NULL) { // first block
+    p->current = p->first;
+  } else {
+    p->current = block_next(p->current);
+  }
+  return p->current;
+}
+
+
+/* Static functions ***********************************************************/
+
+// free all the blocks
+static void program_clear(program_t *p) {
+  block_t *b, *tmp;
+  if (p->arena) { // single bulk release
+    arena_free(p->arena);
+    p->arena = NULL;
+  } else {
+    b = p->first;
+    while (b) {
+      tmp = b;
+      b = block_next(b);
+      block_free(tmp);
+    }
+  }
+  if (p->map) { // blocks are views of the mapping, release it after them
+    munmap((void *)p->map, p->map_len);
+    p->map = NULL;
+    p->map_len = 0;
+  }
+  p->first = p->current = p->last = p->ready = NULL;
+  p->n = p->n_ready = p->n_done = 0;
+}
+
+// Parses the mapped file one line at a time
+static ccnc_error_t program_parse_sequential(program_t *p,
+                                             machine_t const *m) {
+  char const *line = p->map, *end = p->map + p->map_len, *eol = NULL;
+  size_t line_len = 0;
+  block_t *b = NULL;
+
+  while (line < end) {
+    eol = memchr(line, '\n', end - line);
+    line_len = eol ? eol - line : end - line;
+    if (!(b = block_new_view(line, line_len, p->last, m, p->arena))) {
+      eprintf("Error creating a block from line %.*s\n", (int)line_len, line);
+      return PARSE_ERR;
+    }
+    if (machine_lookahead(m) > 0) {
+      block_lookahead(b, machine_lookahead(m));
+    }
+    if (p->first == NULL) {
+      p->first = b;
+    }
+    p->last = b;
+    p->n++;
+    line += line_len + 1;
+  }
+  if (p->last && machine_lookahead(m) > 0) {
+    block_lookahead_end(p->last, machine_lookahead(m));
+  }
+  program_reset(p);
+  return NO_ERR;
+}
+
+// Parallel parsing in three steps: the mapped file is split into lines;
+// then a pool of threads creates and lexes the blocks, each on a contiguous
+// range of lines and in its own arena; finally the blocks are linked in
+// program order, resolving the modal state and computing geometry, profiles
+// and look-ahead
+static ccnc_error_t program_parse_parallel(program_t *p, machine_t const *m,
+                                           size_t threads) {
+  char const *line = p->map, *end = p->map + p->map_len, *eol = NULL;
+  char const **lines = NULL, **tmp = NULL;
+  size_t n = 0, cap = 1024, i, fail, chunk;
+  block_t **blocks = NULL, *b;
+  pthread_t *pool = NULL;
+  program_lexer_t *lexers = NULL;
+  ccnc_error_t error = NO_ERR;
+
+  // 1. Split lines
+  if (!(lines = malloc(cap * sizeof(char *)))) {
+    eprintf("Could not allocate memory for the parser\n");
+    return ALLOC_ERR;
+  }
+  while (line < end) {
+    if (n == cap) {
+      cap *= 2;
+      if (!(tmp = realloc(lines, cap * sizeof(char *)))) {
+        eprintf("Could not allocate memory for the parser\n");
+        error = ALLOC_ERR;
+        goto done;
+      }
+      lines = tmp;
+    }
+    lines[n++] = line;
+    eol = memchr(line, '\n', end - line);
+    line = eol ? eol + 1 : end;
+  }
+
+  // 2. Lex
+  threads = MIN(threads, n);
+  blocks = malloc(n * sizeof(block_t *));
+  pool = calloc(threads, sizeof(pthread_t));
+  lexers = calloc(threads, sizeof(program_lexer_t));
+  if (!blocks || !pool || !lexers) {
+    eprintf("Could not allocate memory for the parser\n");
+    error = ALLOC_ERR;
+    goto done;
+  }
+  chunk = (n + threads - 1) / threads;
+  for (i = 0; i < threads; i++) {
+    lexers[i].lines = lines + MIN(i * chunk, n);
+    lexers[i].blocks = blocks + MIN(i * chunk, n);
+    lexers[i].n = MIN(chunk, n - MIN(i * chunk, n));
+    lexers[i].end = end;
+    lexers[i].machine = m;
+    if (rt_helper_create(&pool[i], program_lexer, &lexers[i])) {
+      eprintf("Could not start a parser thread\n");
+      program_lexer(&lexers[i]); // fall back to this thread
+      pool[i] = pthread_self();
+    }
+  }
+  fail = n;
+  for (i = 0; i < threads; i++) {
+    if (!pthread_equal(pool[i], pthread_self()))
+      pthread_join(pool[i], NULL);
+    if (lexers[i].arena)
+      arena_merge(p->arena, lexers[i].arena);
+    if (lexers[i].fail < lexers[i].n)
+      fail = MIN(fail, i * chunk + lexers[i].fail);
+  }
+
+  // 3. Link
+  for (i = 0; i < n; i++) {
+    b = blocks[i];
+    if (i == fail || block_link(b, p->last) != NO_ERR) {
+      if (i < fail)
+        block_free(b); // detach it
+      eol = memchr(lines[i], '\n', end - lines[i]);
+      eprintf("Error creating a block from line %.*s\n",
+              (int)((eol ? eol : end) - lines[i]), lines[i]);
+      error = PARSE_ERR;
+      break;
+    }
+    if (machine_lookahead(m) > 0) {
+      block_lookahead(b, machine_lookahead(m));
+    }
+    if (p->first == NULL) {
+      p->first = b;
+    }
+    p->last = b;
+    p->n++;
+  }
+  if (p->last && machine_lookahead(m) > 0) {
+    block_lookahead_end(p->last, machine_lookahead(m));
+  }
+  program_reset(p);
+
+done:
+  free(lines);
+  free(blocks);
+  free(pool);
+  free(lexers);
+  return error;
+}
+
+// Parser thread: creates and lexes the blocks of a range of lines
+static void *program_lexer(void *arg) {
+  program_lexer_t *l = (program_lexer_t *)arg;
+  char const *eol;
+  size_t len;
+  if (!(l->arena = arena_new(0))) {
+    l->fail = 0;
+    return NULL;
+  }
+  for (l->fail = 0; l->fail < l->n; l->fail++) {
+    eol = memchr(l->lines[l->fail], '\n', l->end - l->lines[l->fail]);
+    len = (eol ? eol : l->end) - l->lines[l->fail];
+    l->blocks[l->fail] =
+        block_alloc(l->lines[l->fail], len, l->machine, l->arena);
+    if (!l->blocks[l->fail] || block_lex(l->blocks[l->fail]) != NO_ERR)
+      break;
+  }
+  return NULL;
+}
+
+// Maps the G-code file read-only in memory
+static ccnc_error_t program_map(program_t *p) {
+  struct stat st;
+  void *map;
+  int fd = open(p->filename, O_RDONLY);
+  if (fd < 0) {
+    eprintf("Cannot open the file at %s\n", p->filename);
+    return FILE_ERR;
+  }
+  if (fstat(fd, &st) != 0) {
+    eprintf("Cannot stat the file at %s\n", p->filename);
+    close(fd);
+    return FILE_ERR;
+  }
+  if (st.st_size == 0) { // nothing to map, empty program
+    close(fd);
+    return NO_ERR;
+  }
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    eprintf("Cannot map the file at %s in memory\n", p->filename);
+    return FILE_ERR;
+  }
+  // lines are parsed in order
+  madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+  p->map = (char const *)map;
+  p->map_len = (size_t)st.st_size;
+  return NO_ERR;
+}
+
+static ccnc_error_t program_stream_start(program_t *p) {
+  p->eof = p->stop = 0;
+  p->error = NO_ERR;
+  if (rt_helper_create(&p->reader, program_reader, p)) {
+    eprintf("Could not start the program reader thread\n");
+    // with no reader, program_next() must not wait for blocks
+    p->eof = 1;
+    p->error = UNKNOWN_ERR;
+    return UNKNOWN_ERR;
+  }
+  p->running = 1;
+  return NO_ERR;
+}
+
+static void program_stream_stop(program_t *p) {
+  if (!p->running)
+    return;
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  pthread_join(p->reader, NULL);
+  p->running = 0;
+}
+
+// Background parser: appends blocks to the list, keeping at most p->window
+// ready blocks ahead of the one being executed. A block is ready when the 
+// look-ahead window has moved past it, so that its profile is final.
+static void *program_reader(void *arg) {
+  program_t *p = (program_t *)arg;
+  machine_t const *m = p->machine;
+  size_t lookahead = MAX(machine_lookahead(m), 0);
   FILE *file = NULL;
   ssize_t line_len = 0;
   size_t n = 0;
   char *line = NULL;
   block_t *b = NULL;
+  ccnc_error_t error = NO_ERR;
 
   file = fopen(p->filename, "r");
   if (!file) {
     eprintf("Cannot open the file at %s\n", p->filename);
-    return FILE_ERR;
+    error = FILE_ERR;
+    goto done;
   }
 
-  // Parsing loop
   while ((line_len = getline(&line, &n, file)) >= 0) {
     if (line[line_len - 1] == '\n') {
       line[line_len - 1] = '\0';
     }
+    // p->last is only written by this thread
     if (!(b = block_new(line, p->last, m))) {
       eprintf("Error creating a block from line %s\n", line);
-      return PARSE_ERR;
+      error = PARSE_ERR;
+      break;
+    }
+    if (lookahead > 0) {
+      block_lookahead(b, lookahead);
     }
+    pthread_mutex_lock(&p->lock);
     if (p->first == NULL) {
       p->first = b;
     }
     p->last = b;
     p->n++;
+    while (p->n - p->n_ready > lookahead) {
+      p->ready = p->ready ? block_next(p->ready) : p->first;
+      p->n_ready++;
+    }
+    pthread_cond_broadcast(&p->cond);
+    while (p->n_ready - p->n_done >= p->window && !p->stop) {
+      pthread_cond_wait(&p->cond, &p->lock);
+    }
+    if (p->stop) {
+      pthread_mutex_unlock(&p->lock);
+      break;
+    }
+    pthread_mutex_unlock(&p->lock);
   }
   fclose(file);
   free(line);
-  program_reset(p);
-  return NO_ERR;
-}
+  // p->last is not ready yet, so it can still be planned without locking.
+  // After a parsing error too, the blocks parsed so far end at rest, before
+  // the program is aborted
+  if (!p->stop && p->last && lookahead > 0) {
+    block_lookahead_end(p->last, lookahead);
+  }
 
-void program_reset(program_t *p) {
-  assert(p);
-  p->current = NULL;
+done:
+  pthread_mutex_lock(&p->lock);
+  p->ready = p->last;
+  p->n_ready = p->n;
+  p->error = error;
+  p->eof = 1;
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
 }
 
-block_t *program_next(program_t *p) {
-  assert(p);
-  if (p->current == NULL) { // first block
-    p->current = p->first;
-  } else {
-    p->current = block_next(p->current);
+// Waits for the next ready block and frees the blocks already executed, 
+// keeping only the one preceding the current block (its target is the 
+// current block start point)
+static block_t *program_stream_next(program_t *p) {
+  block_t *b;
+  pthread_mutex_lock(&p->lock);
+  // once at the end, start over like in non-streaming mode
+  if (p->eof && p->current == NULL && p->n_done > 0) {
+    pthread_mutex_unlock(&p->lock);
+    if (program_reset(p) != NO_ERR)
+      return NULL;
+    pthread_mutex_lock(&p->lock);
+  }
+  while (p->n_ready == p->n_done && !p->eof) {
+    pthread_cond_wait(&p->cond, &p->lock);
+  }
+  if (p->n_ready == p->n_done) { // end of program or parsing error
+    p->current = NULL;
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
   }
+  p->current = p->current ? block_next(p->current) : p->first;
+  p->n_done++;
+  while (p->first != p->current && block_next(p->first) != p->current) {
+    b = p->first;
+    p->first = block_next(b);
+    block_free(b);
+  }
+  pthread_cond_broadcast(&p->cond);
+  pthread_mutex_unlock(&p->lock);
   return p->current;
 }
 
 
+// 64 bit hash, mixing 8 bytes at a time (not meant to be cryptographic)
+static uint64_t program_hash(void const *data, size_t len, uint64_t h) {
+  unsigned char const *c = (unsigned char const *)data;
+  uint64_t w;
+  for (; len >= 8; c += 8, len -= 8) {
+    memcpy(&w, c, 8);
+    h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+  }
+  for (; len > 0; c++, len--) {
+    h = (h ^ *c) * 0x100000001B3ULL;
+  }
+  return h ^ (h >> 29);
+}
+
+// The cache key covers the G-code text, the machine parameters used by the
+// parser and the record layout
+static uint64_t program_cache_key(program_t const *p, machine_t const *m) {
+  data_t par[] = {machine_A(m),
+                  machine_J(m),
+                  machine_max_error(m),
+                  machine_tq(m),
+                  machine_fmax(m),
+                  point_x(machine_axis_A(m)),
+                  point_y(machine_axis_A(m)),
+                  point_z(machine_axis_A(m)),
+                  point_x(machine_axis_fmax(m)),
+                  point_y(machine_axis_fmax(m)),
+                  point_z(machine_axis_fmax(m)),
+                  point_x(machine_zero(m)),
+                  point_y(machine_zero(m)),
+                  point_z(machine_zero(m)),
+                  machine_lookahead(m),
+                  machine_continuous(m),
+                  sizeof(block_record_t)};
+  uint64_t h = program_hash(p->map, p->map_len, 0xCBF29CE484222325ULL);
+  return program_hash(par, sizeof(par), h);
+}
+
+// Loads the blocks from <filename>.ccnc, if it exists and its key matches
+static ccnc_error_t program_cache_load(program_t *p, machine_t const *m,
+                                       uint64_t key) {
+  char path[PATH_MAX];
+  program_cache_t const *head;
+  block_record_t const *rec;
+  block_t *b;
+  struct stat st;
+  void *map;
+  size_t i;
+  int fd;
+  ccnc_error_t error = NO_ERR;
+
+  if (snprintf(path, sizeof(path), "%s" CACHE_EXT, p->filename) >=
+          (int)sizeof(path) ||
+      (fd = open(path, O_RDONLY)) < 0) {
+    return FILE_ERR;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(program_cache_t)) {
+    close(fd);
+    return FILE_ERR;
+  }
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return FILE_ERR;
+  }
+  head = (program_cache_t const *)map;
+  rec = (block_record_t const *)(head + 1);
+  if (memcmp(head->magic, CACHE_MAGIC, sizeof(head->magic)) != 0 ||
+      head->version != CACHE_VERSION || head->key != key ||
+      head->record_size != sizeof(block_record_t) ||
+      (size_t)st.st_size !=
+          sizeof(program_cache_t) + head->n * sizeof(block_record_t)) {
+    wprintf("Cache %s is outdated, parsing the program again\n", path);
+    munmap(map, (size_t)st.st_size);
+    return FILE_ERR;
+  }
+  for (i = 0; i < head->n; i++) {
+    // a damaged cache must not make the line views run past the G-code text
+    if (rec[i].src_offset > p->map_len ||
+        rec[i].src_len > p->map_len - rec[i].src_offset) {
+      wprintf("Cache %s is corrupt, parsing the program again\n", path);
+      error = FILE_ERR;
+      break;
+    }
+    if (!(b = block_load(&rec[i], p->map, p->last, m, p->arena))) {
+      error = ALLOC_ERR;
+      break;
+    }
+    if (p->first == NULL) {
+      p->first = b;
+    }
+    p->last = b;
+    p->n++;
+  }
+  munmap(map, (size_t)st.st_size);
+  // the blocks loaded so far would be duplicated by parsing the program:
+  // release them, keeping the mapping of the file
+  if (error != NO_ERR) {
+    arena_free(p->arena);
+    p->arena = arena_new(0); // if NULL, blocks are allocated one by one
+    p->first = p->last = NULL;
+    p->n = 0;
+  }
+  return error;
+}
+
+// Saves the blocks to <filename>.ccnc, through a temporary file so that a
+// partially written cache is never loaded
+static void program_cache_save(program_t const *p, uint64_t key) {
+  char path[PATH_MAX], tmp[PATH_MAX];
+  program_cache_t head;
+  block_record_t rec;
+  block_t *b;
+  FILE *file;
+  int ok;
+
+  snprintf(path, sizeof(path), "%s" CACHE_EXT, p->filename);
+  if (snprintf(tmp, sizeof(tmp), "%s" CACHE_EXT ".tmp", p->filename) >=
+          (int)sizeof(tmp) ||
+      !(file = fopen(tmp, "wb"))) {
+    wprintf("Cannot write the program cache %s\n", tmp);
+    return;
+  }
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, CACHE_MAGIC, sizeof(head.magic));
+  head.version = CACHE_VERSION;
+  head.record_size = sizeof(block_record_t);
+  head.key = key;
+  head.n = p->n;
+  ok = fwrite(&head, sizeof(head), 1, file) == 1;
+  for (b = p->first; b && ok; b = block_next(b)) {
+    block_save(b, p->map, &rec);
+    ok = fwrite(&rec, sizeof(rec), 1, file) == 1;
+  }
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    wprintf("Cannot write the program cache %s\n", path);
+    remove(tmp);
+  }
+}
 
 
 /*
@@ -186,9 +769,6 @@ int main(int argc, char const **argv) {
   program_reset(p);
   printf("N t tt lambda s v X Y Z\n");
   while((curr_b = program_next(p))) {
-    if (block_type(curr_b) == RAPID) {
-      continue;
-    }
     dt = block_dt(curr_b);
     for (t = 0; t - dt < tq / 10.0; t += tq, tt += tq) {
       pos = block_interpolate_t(curr_b, t, &lambda, &v);
@@ -198,6 +778,10 @@ int main(int argc, char const **argv) {
       printf("%03lu %.3f %.3f %.6f %.3f %.3f %.3f %.3f %.3f\n", block_n(curr_b), t, tt, lambda, lambda * block_length(curr_b), v, point_x(pos), point_y(pos), point_z(pos));
     }
   }
+  if (program_error(p) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    exit(EXIT_FAILURE);
+  }
 
   program_free(p);
   machine_free(m);
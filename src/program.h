@@ -46,11 +46,16 @@ size_t program_length(program_t const *p);
 block_t *program_first(program_t const *p);
 block_t *program_current(program_t const *p);
 block_t *program_last(program_t const *p);
+// Parsing error of a streamed program, once the reader thread has failed
+// (program_next() then returns NULL as at the end of the program)
+ccnc_error_t program_error(program_t *p);
 
 
 /* Methods ********************************************************************/
 ccnc_error_t program_parse(program_t *program, machine_t const *machine);
-void program_reset(program_t *program);
+// Rewinds the program; a streamed one is parsed again by a new reader
+// thread, and the error is returned if it cannot be started
+ccnc_error_t program_reset(program_t *program);
 block_t *program_next(program_t *program);
 
 
@@ -0,0 +1,195 @@
+/*
+  ___                               _
+ / _ \ _   _  ___ _   _  ___    ___| | __ _ ___ ___
+| | | | | | |/ _ \ | | |/ _ \  / __| |/ _` / __/ __|
+| |_| | |_| |  __/ |_| |  __/ | (__| | (_| \__ \__ \
+ \__\_\\__,_|\___|\__,_|\___|  \___|_|\__,_|___/___/
+
+* This is the implementation of the Queue class of C-CNC
+*/
+#include "queue.h"
+#include <stdatomic.h>
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Head and tail are on separate cache lines, so that the producer and the
+// consumer do not invalidate each other's line on every operation
+#define QUEUE_LINE 64
+
+// Structure representing the Queue class
+typedef struct queue {
+  _Alignas(QUEUE_LINE) _Atomic size_t head; // next item to pop (consumer)
+  _Alignas(QUEUE_LINE) _Atomic size_t tail; // next item to push (producer)
+  _Alignas(QUEUE_LINE) size_t mask;         // capacity - 1
+  size_t item_size;                         // bytes per item
+  unsigned char *data;                      // items
+} queue_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+queue_t *queue_new(size_t capacity, size_t item_size) {
+  queue_t *q = NULL;
+  size_t size = 2;
+  assert(item_size > 0);
+  while (size < capacity)
+    size <<= 1;
+  q = aligned_alloc(QUEUE_LINE, sizeof(queue_t));
+  if (!q) {
+    eprintf("Error allocating memory for a queue\n");
+    return NULL;
+  }
+  memset(q, 0, sizeof(*q));
+  q->data = calloc(size, item_size);
+  if (!q->data) {
+    eprintf("Error allocating memory for %zu queue items\n", size);
+    free(q);
+    return NULL;
+  }
+  q->mask = size - 1;
+  q->item_size = item_size;
+  return q;
+}
+
+void queue_free(queue_t *q) {
+  assert(q);
+  free(q->data);
+  free(q);
+  q = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+size_t queue_capacity(queue_t const *q) {
+  assert(q);
+  return q->mask + 1;
+}
+
+size_t queue_length(queue_t const *q) {
+  assert(q);
+  return atomic_load_explicit(&q->tail, memory_order_acquire) -
+         atomic_load_explicit(&q->head, memory_order_acquire);
+}
+
+/* METHODS ********************************************************************/
+// Indexes grow forever and are masked on access: head == tail is empty,
+// tail - head == capacity is full. The release store of the index publishes
+// the item copied before it
+int queue_push(queue_t *q, void const *item) {
+  assert(q && item);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  if (tail - head > q->mask)
+    return 0;
+  memcpy(q->data + (tail & q->mask) * q->item_size, item, q->item_size);
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+int queue_pop(queue_t *q, void *item) {
+  assert(q && item);
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head == tail)
+    return 0;
+  memcpy(item, q->data + (head & q->mask) * q->item_size, q->item_size);
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return 1;
+}
+
+void const *queue_peek(queue_t const *q) {
+  assert(q);
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head == tail)
+    return NULL;
+  return q->data + (head & q->mask) * q->item_size;
+}
+
+void queue_clear(queue_t *q) {
+  assert(q);
+  atomic_store(&q->head, 0);
+  atomic_store(&q->tail, 0);
+}
+
+/*
+  ___                          _            _
+ / _ \ _   _  ___ _   _  ___  | |_ ___  ___| |_
+| | | | | | |/ _ \ | | |/ _ \ | __/ _ \/ __| __|
+| |_| | |_| |  __/ |_| |  __/ | ||  __/\__ \ |_
+ \__\_\\__,_|\___|\__,_|\___|  \__\___||___/\__|
+
+*/
+#ifdef QUEUE_MAIN
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define QUEUE_ITEMS 1000000
+
+// Pushes a sequence of numbers, retrying when the queue is full. Both sides
+// yield while waiting, or on a single CPU each one would spin for a whole
+// time slice before the other could make progress
+static void *producer(void *arg) {
+  queue_t *q = (queue_t *)arg;
+  uint64_t i;
+  for (i = 0; i < QUEUE_ITEMS; i++) {
+    while (!queue_push(q, &i))
+      sched_yield();
+  }
+  return NULL;
+}
+
+int main() {
+  queue_t *q = queue_new(100, sizeof(uint64_t));
+  pthread_t thread;
+  uint64_t i, v, errors = 0;
+  int ok = 1;
+  printf(BGRN "Queue class test executable, version %s (%s)\n" CRESET,
+         VERSION, BUILD_TYPE);
+
+  // single thread: FIFO order, full and empty conditions
+  assert(queue_capacity(q) == 128);
+  assert(queue_peek(q) == NULL);
+  for (i = 0; i < queue_capacity(q); i++)
+    ok = ok && queue_push(q, &i);
+  ok = ok && !queue_push(q, &i);
+  assert(ok && queue_length(q) == 128);
+  assert(*(uint64_t const *)queue_peek(q) == 0);
+  for (i = 0; i < queue_capacity(q); i++) {
+    ok = ok && queue_pop(q, &v) && v == i;
+  }
+  ok = ok && !queue_pop(q, &v);
+  assert(ok && queue_length(q) == 0);
+
+  // two threads: every item arrives once and in order
+  queue_clear(q);
+  pthread_create(&thread, NULL, producer, q);
+  for (i = 0; i < QUEUE_ITEMS; i++) {
+    while (!queue_pop(q, &v))
+      sched_yield();
+    errors += (v != i);
+  }
+  pthread_join(thread, NULL);
+  printf("Passed %d items between two threads, %" PRIu64 " out of order\n",
+         QUEUE_ITEMS, errors);
+  assert(errors == 0);
+
+  queue_free(q);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+  ___                               _
+ / _ \ _   _  ___ _   _  ___    ___| | __ _ ___ ___
+| | | | | | |/ _ \ | | |/ _ \  / __| |/ _` / __/ __|
+| |_| | |_| |  __/ |_| |  __/ | (__| | (_| \__ \__ \
+ \__\_\\__,_|\___|\__,_|\___|  \___|_|\__,_|___/___/
+
+* Single-producer, single-consumer ring buffer of fixed size items: one
+* thread pushes and one thread pops, without locks nor system calls
+*/
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "defines.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Queue class
+typedef struct queue queue_t;
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// Room for at least capacity items of item_size bytes (the capacity is
+// rounded up to a power of two)
+queue_t *queue_new(size_t capacity, size_t item_size);
+void queue_free(queue_t *q);
+
+
+/* ACCESSORS ******************************************************************/
+size_t queue_capacity(queue_t const *q);
+// Number of queued items (a snapshot, when the other thread is running)
+size_t queue_length(queue_t const *q);
+
+
+/* METHODS ********************************************************************/
+// Producer side: copies the item in the queue; returns 0 when full
+int queue_push(queue_t *q, void const *item);
+// Consumer side: copies the oldest item out of the queue; returns 0 when
+// empty
+int queue_pop(queue_t *q, void *item);
+// Consumer side: the oldest item, left in the queue (NULL when empty)
+void const *queue_peek(queue_t const *q);
+// Empties the queue; only when neither side is running
+void queue_clear(queue_t *q);
+
+
+#endif // QUEUE_H
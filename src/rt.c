@@ -0,0 +1,48 @@
+/*
+  ____ _____
+ |  _ \_   _|
+ | |_) || |
+ |  _ < | |
+ |_| \_\|_|
+
+* This is the implementation of the real-time support of C-CNC
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pthread_attr_setaffinity_np()
+#endif
+#include "rt.h"
+#include <sched.h>
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* METHODS ********************************************************************/
+int rt_helper_create(pthread_t *thread, void *(*func)(void *), void *arg) {
+  assert(thread && func);
+  pthread_attr_t attr;
+  struct sched_param param = {.sched_priority = 0};
+  int ret;
+  pthread_attr_init(&attr);
+  pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+  pthread_attr_setschedparam(&attr, &param);
+#ifdef __linux__
+  {
+    cpu_set_t cpus;
+    int i;
+    CPU_ZERO(&cpus);
+    for (i = 0; i < CPU_SETSIZE; i++)
+      CPU_SET(i, &cpus);
+    pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+  }
+#endif
+  ret = pthread_create(thread, &attr, func, arg);
+  pthread_attr_destroy(&attr);
+  return ret;
+}
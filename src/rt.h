@@ -0,0 +1,34 @@
+/*
+  ____ _____
+ |  _ \_   _|
+ | |_) || |
+ |  _ < | |
+ |_| \_\|_|
+
+* Real-time support: threads started by the real-time loop that must not
+* share its scheduling
+*/
+#ifndef RT_H
+#define RT_H
+
+#include "defines.h"
+#include <pthread.h>
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* METHODS ********************************************************************/
+// Starts a helper thread (parser, trajectory producer, log writer) with the
+// default scheduler, on any CPU: it does not inherit the SCHED_FIFO priority
+// and the CPU affinity of the real-time loop that starts it. Returns as
+// pthread_create()
+int rt_helper_create(pthread_t *thread, void *(*func)(void *), void *arg);
+
+
+#endif // RT_H
@@ -0,0 +1,419 @@
+/*
+ _____           _           _                          _
+|_   _| __ __ _ (_) ___  ___| |_ ___  _ __ _   _    ___| | __ _ ___ ___
+  | || '__/ _` || |/ _ \/ __| __/ _ \| '__| | | |  / __| |/ _` / __/ __|
+  | || | | (_| || |  __/ (__| || (_) | |  | |_| | | (__| | (_| \__ \__ \
+  |_||_|  \__,_|/ |\___|\___|\__\___/|_|   \__, |  \___|_|\__,_|___/___/
+              |__/                         |___/
+
+* This is the implementation of the Trajectory class of C-CNC
+*/
+#include "trajectory.h"
+#include "queue.h"
+#include "rt.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/param.h>
+#include <time.h>
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// The producer sleeps for this fraction of the queued time when the queue
+// is full, and never longer than TRAJECTORY_MAX_PAUSE (s)
+#define TRAJECTORY_REFILL 0.25
+#define TRAJECTORY_MAX_PAUSE 0.01
+// Polling interval while waiting for the producer (s)
+#define TRAJECTORY_POLL 1E-4
+// Sampling instants closer than this fraction of tq to the end of a block
+// belong to the next block (continuous time)
+#define TRAJECTORY_EPS 1E-6
+
+// Structure representing the Trajectory class
+typedef struct trajectory {
+  program_t *program;       // program walked by the producer
+  machine_t const *machine; // machine parameters
+  queue_t *queue;           // setpoints, from the producer to the loop
+  struct timespec pause;    // producer sleep time when the queue is full
+  pthread_t producer;       // producer thread
+  int running;              // producer started and not yet joined
+  atomic_int stop;          // asks the producer to quit
+  atomic_int done;          // the whole program has been queued
+  atomic_int ready;         // queue filled once, or whole program queued
+  size_t underruns;         // empty queue on trajectory_pop()
+} trajectory_t;
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* STATIC FUNCTIONS ***********************************************************/
+static void *trajectory_producer(void *arg);
+static int trajectory_push(trajectory_t *t, setpoint_t const *sp);
+static void trajectory_sleep(data_t seconds);
+
+/* LIFECYCLE ******************************************************************/
+trajectory_t *trajectory_new(program_t *p, machine_t const *m) {
+  assert(p && m);
+  trajectory_t *t = NULL;
+  data_t pause;
+  t = malloc(sizeof(trajectory_t));
+  if (!t) {
+    eprintf("Error allocating memory for a trajectory\n");
+    return NULL;
+  }
+  memset(t, 0, sizeof(*t));
+  t->program = p;
+  t->machine = m;
+  t->queue = queue_new(MAX(machine_queue(m), 1), sizeof(setpoint_t));
+  if (!t->queue) {
+    free(t);
+    return NULL;
+  }
+  pause = machine_tq(m) * machine_rt_pacing(m) * queue_capacity(t->queue) *
+          TRAJECTORY_REFILL;
+  pause = MIN(pause, TRAJECTORY_MAX_PAUSE);
+  t->pause.tv_sec = 0;
+  t->pause.tv_nsec = pause * 1E9;
+  return t;
+}
+
+void trajectory_free(trajectory_t *t) {
+  assert(t);
+  trajectory_stop(t);
+  queue_free(t->queue);
+  free(t);
+  t = NULL;
+}
+
+/* ACCESSORS ******************************************************************/
+size_t trajectory_underruns(trajectory_t const *t) {
+  assert(t);
+  return t->underruns;
+}
+
+size_t trajectory_length(trajectory_t const *t) {
+  assert(t);
+  return queue_length(t->queue);
+}
+
+int trajectory_ready(trajectory_t const *t) {
+  assert(t);
+  return atomic_load(&t->ready);
+}
+
+/* METHODS ********************************************************************/
+ccnc_error_t trajectory_start(trajectory_t *t) {
+  assert(t);
+  ccnc_error_t error = NO_ERR;
+  trajectory_stop(t);
+  if ((error = program_reset(t->program)) != NO_ERR)
+    return error;
+  atomic_store(&t->stop, 0);
+  atomic_store(&t->done, 0);
+  atomic_store(&t->ready, 0);
+  t->underruns = 0;
+  if (rt_helper_create(&t->producer, trajectory_producer, t)) {
+    eprintf("Could not start the trajectory producer thread\n");
+    return UNKNOWN_ERR;
+  }
+  t->running = 1;
+  return NO_ERR;
+}
+
+void trajectory_stop(trajectory_t *t) {
+  assert(t);
+  if (!t->running)
+    return;
+  atomic_store(&t->stop, 1);
+  pthread_join(t->producer, NULL);
+  t->running = 0;
+  queue_clear(t->queue);
+}
+
+int trajectory_pop(trajectory_t *t, setpoint_t *sp) {
+  assert(t && sp);
+  if (queue_pop(t->queue, sp))
+    return 1;
+  t->underruns++;
+  return 0;
+}
+
+size_t trajectory_pop_block(trajectory_t *t, setpoint_t *sp, size_t n,
+                            setpoint_t const *prev) {
+  assert(t && sp);
+  setpoint_t const *next;
+  size_t i;
+  for (i = 0; i < n; prev = &sp[i++]) {
+    if (!(next = queue_peek(t->queue))) {
+      if (i == 0)
+        t->underruns++;
+      break;
+    }
+    if (next->flags & SETPOINT_END)
+      break;
+    // rapids end with an in-position check
+    if (prev && (prev->flags & SETPOINT_LAST) &&
+        (prev->type == RAPID || next->type == RAPID))
+      break;
+    queue_pop(t->queue, &sp[i]);
+  }
+  return i;
+}
+
+setpoint_t const *trajectory_peek(trajectory_t *t) {
+  assert(t);
+  setpoint_t const *sp = queue_peek(t->queue);
+  // still filling the queue after a start is not being late
+  if (!sp && t->running && atomic_load(&t->ready))
+    t->underruns++;
+  return sp;
+}
+
+setpoint_t const *trajectory_head(trajectory_t *t) {
+  assert(t);
+  return queue_peek(t->queue);
+}
+
+setpoint_t const *trajectory_wait(trajectory_t *t) {
+  assert(t);
+  setpoint_t const *sp = queue_peek(t->queue);
+  if (sp || !t->running)
+    return sp;
+  t->underruns++;
+  while (!(sp = queue_peek(t->queue))) {
+    // the last setpoint is queued before done is set
+    if (atomic_load(&t->done))
+      return queue_peek(t->queue);
+    trajectory_sleep(TRAJECTORY_POLL);
+  }
+  return sp;
+}
+
+/* STATIC FUNCTIONS ***********************************************************/
+// Walks the program from the beginning, with the same timing of the
+// interp_motion and rapid_motion states: setpoints every tq seconds, until
+// the first one past the block duration.
+// In continuous time, setpoints are tq apart across junctions too: the
+// first one of a block falls residual seconds after its start, residual
+// being what was left of the tick in which the previous block ended.
+// Blocks ending at rest get a last setpoint on their end point, and the
+// next one starts afresh; a block shorter than the residual gets no
+// setpoints at all
+static void *trajectory_producer(void *arg) {
+  trajectory_t *t = (trajectory_t *)arg;
+  data_t tq = machine_tq(t->machine);
+  data_t dt, eps = tq * TRAJECTORY_EPS, residual = 0;
+  int continuous = machine_continuous(t->machine), rest;
+  setpoint_t sp;
+  point_t pos;
+  block_t *b = NULL;
+
+  while (!atomic_load(&t->stop) && (b = program_next(t->program))) {
+    memset(&sp, 0, sizeof(sp));
+    sp.n = block_n(b);
+    sp.type = block_type(b);
+    sp.length = block_length(b);
+    sp.flags = SETPOINT_FIRST;
+    switch (sp.type) {
+    case RAPID:
+    case LINE:
+    case CWA:
+    case CCWA:
+      if (continuous) {
+        dt = block_dt(b);
+        rest = block_profile(b)->fe == 0;
+        for (sp.t_blk = residual; sp.t_blk < dt - eps; sp.t_blk += tq) {
+          if (!rest && sp.t_blk + tq >= dt - eps)
+            sp.flags |= SETPOINT_LAST;
+          sp.lambda = block_lambda(b, sp.t_blk, &sp.feedrate);
+          block_interpolate_to(b, sp.lambda, &pos);
+          sp.x = point_x(&pos);
+          sp.y = point_y(&pos);
+          sp.z = point_z(&pos);
+          if (!trajectory_push(t, &sp))
+            goto done;
+          sp.flags = 0;
+        }
+        residual = MAX(sp.t_blk - dt, 0);
+        if (rest) {
+          sp.t_blk = dt;
+          sp.lambda = block_lambda(b, dt, &sp.feedrate);
+          block_interpolate_to(b, sp.lambda, &pos);
+          sp.x = point_x(&pos);
+          sp.y = point_y(&pos);
+          sp.z = point_z(&pos);
+          sp.flags |= SETPOINT_LAST;
+          if (!trajectory_push(t, &sp))
+            goto done;
+          residual = 0;
+        }
+        break;
+      }
+      for (sp.t_blk = 0;; sp.t_blk += tq) {
+        sp.lambda = block_lambda(b, sp.t_blk, &sp.feedrate);
+        block_interpolate_to(b, sp.lambda, &pos);
+        sp.x = point_x(&pos);
+        sp.y = point_y(&pos);
+        sp.z = point_z(&pos);
+        if (sp.t_blk >= block_dt(b) + tq / 10.0)
+          sp.flags |= SETPOINT_LAST;
+        if (!trajectory_push(t, &sp))
+          goto done;
+        if (sp.flags & SETPOINT_LAST)
+          break;
+        sp.flags = 0;
+      }
+      break;
+    default:
+      sp.flags |= SETPOINT_LAST;
+      if (!trajectory_push(t, &sp))
+        goto done;
+      residual = 0;
+      break;
+    }
+  }
+  memset(&sp, 0, sizeof(sp));
+  sp.flags = SETPOINT_END;
+  // a streamed program ends early on a parsing error
+  if (!atomic_load(&t->stop) && program_error(t->program) != NO_ERR)
+    sp.flags |= SETPOINT_ERROR;
+  trajectory_push(t, &sp);
+done:
+  atomic_store(&t->done, 1);
+  atomic_store(&t->ready, 1);
+  return NULL;
+}
+
+// Waits for room in the queue; returns 0 if asked to stop meanwhile. The
+// trajectory is ready as soon as the queue is full
+static int trajectory_push(trajectory_t *t, setpoint_t const *sp) {
+  while (!queue_push(t->queue, sp)) {
+    atomic_store(&t->ready, 1);
+    if (atomic_load(&t->stop))
+      return 0;
+    nanosleep(&t->pause, NULL);
+  }
+  return 1;
+}
+
+static void trajectory_sleep(data_t seconds) {
+  struct timespec ts = {.tv_sec = 0, .tv_nsec = seconds * 1E9};
+  nanosleep(&ts, NULL);
+}
+
+/*
+ _____           _           _                     _            _
+|_   _| __ __ _ (_) ___  ___| |_ ___  _ __ _   _  | |_ ___  ___| |_
+  | || '__/ _` || |/ _ \/ __| __/ _ \| '__| | | | | __/ _ \/ __| __|
+  | || | | (_| || |  __/ (__| || (_) | |  | |_| | | ||  __/\__ \ |_
+  |_||_|  \__,_|/ |\___|\___|\__\___/|_|   \__, |  \__\___||___/\__|
+              |__/                         |___/
+
+*/
+#ifdef TRAJECTORY_MAIN
+// Compares the queued setpoints with the block interpolation
+int main(int argc, char const **argv) {
+  machine_t *m = NULL;
+  program_t *p = NULL;
+  trajectory_t *t = NULL;
+  setpoint_t *sps = NULL, sp;
+  block_t *b = NULL;
+  point_t *pos = NULL, queued;
+  data_t tq, tb, lambda, v, err = 0;
+  size_t n = 0, size = 1024, i = 0;
+
+  if (argc != 3) {
+    eprintf("I need exactly two arguments: G-code file, and INI file\n");
+    exit(EXIT_FAILURE);
+  }
+  m = machine_new(argv[2]);
+  p = program_new(argv[1]);
+  if (!m || !p || program_parse(p, m) != NO_ERR) {
+    eprintf("Error parsing the program\n");
+    exit(EXIT_FAILURE);
+  }
+  t = trajectory_new(p, m);
+  if (!t || trajectory_start(t) != NO_ERR) {
+    exit(EXIT_FAILURE);
+  }
+  while (!trajectory_ready(t))
+    trajectory_sleep(TRAJECTORY_POLL);
+  printf("Queued %zu setpoints at start\n", trajectory_length(t));
+
+  // consume the whole program, faster than real time
+  sps = malloc(size * sizeof(setpoint_t));
+  do {
+    if (!trajectory_wait(t) || !trajectory_pop(t, &sp))
+      break;
+    if (n == size) {
+      size *= 2;
+      sps = realloc(sps, size * sizeof(setpoint_t));
+    }
+    sps[n++] = sp;
+  } while (!(sp.flags & SETPOINT_END));
+  trajectory_stop(t);
+  printf("Popped %zu setpoints, %zu underruns\n", n, trajectory_underruns(t));
+  assert(n > 0 && (sps[n - 1].flags & SETPOINT_END));
+  if (sps[n - 1].flags & SETPOINT_ERROR) {
+    eprintf("The program could not be parsed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  tq = machine_tq(m);
+  program_reset(p);
+  while ((b = program_next(p))) {
+    assert(i < n);
+    if (sps[i].n != block_n(b)) {
+      // in continuous time, blocks shorter than a tick may have no setpoints
+      assert(machine_continuous(m) && block_dt(b) < tq);
+      continue;
+    }
+    assert(sps[i].type == block_type(b) && (sps[i].flags & SETPOINT_FIRST));
+    if (block_type(b) == RAPID || block_type(b) == LINE ||
+        block_type(b) == CWA || block_type(b) == CCWA) {
+      for (tb = sps[i].t_blk;; tb += tq, i++) {
+        assert(sps[i].n == block_n(b));
+        if (!(sps[i].flags & SETPOINT_LAST) || !machine_continuous(m))
+          assert(fabs(sps[i].t_blk - tb) < 1E-9);
+        pos = block_interpolate_t(b, sps[i].t_blk, &lambda, &v);
+        point_set_xyz(&queued, sps[i].x, sps[i].y, sps[i].z);
+        err = fmax(err, fabs(sps[i].lambda - lambda) +
+                            fabs(sps[i].feedrate - v) +
+                            point_dist(pos, &queued));
+        if (sps[i].flags & SETPOINT_LAST)
+          break;
+      }
+      // the last setpoint is the first one past the block end, or, in
+      // continuous time, the last one before it (or the end point)
+      if (machine_continuous(m))
+        assert(sps[i].t_blk + tq >= block_dt(b) - tq * 1E-6);
+      else
+        assert(sps[i].t_blk >= block_dt(b) + tq / 10.0 &&
+               sps[i].t_blk - tq < block_dt(b) + tq / 10.0);
+    }
+    assert(sps[i].flags & SETPOINT_LAST);
+    i++;
+  }
+  assert(i == n - 1);
+  printf("Max difference w.r.t. block interpolation: %g\n", err);
+
+  free(sps);
+  trajectory_free(t);
+  program_free(p);
+  machine_free(m);
+  return err == 0 ? 0 : EXIT_FAILURE;
+}
+
+#endif // TRAJECTORY_MAIN
@@ -0,0 +1,109 @@
+/*
+ _____           _           _                          _
+|_   _| __ __ _ (_) ___  ___| |_ ___  _ __ _   _    ___| | __ _ ___ ___
+  | || '__/ _` || |/ _ \/ __| __/ _ \| '__| | | |  / __| |/ _` / __/ __|
+  | || | | (_| || |  __/ (__| || (_) | |  | |_| | | (__| | (_| \__ \__ \
+  |_||_|  \__,_|/ |\___|\___|\__\___/|_|   \__, |  \___|_|\__,_|___/___/
+              |__/                         |___/
+
+* Trajectory generator: a producer thread walks the program and interpolates
+* it ahead of time, queueing one setpoint per sampling time. The real-time
+* loop only pops the setpoints and publishes them
+*/
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include "defines.h"
+#include "block.h"
+#include "machine.h"
+#include "program.h"
+
+/*
+  ____        __ _       _ _   _
+ |  _ \  ___ / _(_)_ __ (_) |_(_) ___  _ __  ___
+ | | | |/ _ \ |_| | '_ \| | __| |/ _ \| '_ \/ __|
+ | |_| |  __/  _| | | | | | |_| | (_) | | | \__ \
+ |____/ \___|_| |_|_| |_|_|\__|_|\___/|_| |_|___/
+
+*/
+
+// Opaque structure representing the Trajectory class
+typedef struct trajectory trajectory_t;
+
+// Setpoint flags
+typedef enum {
+  SETPOINT_FIRST = 1, // first setpoint of a block
+  SETPOINT_LAST = 2,  // last setpoint of a block
+  SETPOINT_END = 4,   // end of program (no block data)
+  SETPOINT_ERROR = 8  // with SETPOINT_END: the program could not be parsed
+} setpoint_flag_t;
+
+// A setpoint carries copies of the block data needed by the real-time loop,
+// for blocks may be released (when streaming) before it is executed.
+// Interpolated blocks have one setpoint per sampling time; rapid and no
+// motion blocks have a single setpoint (the target, for rapids)
+typedef struct {
+  size_t n;          // block number
+  block_type_t type; // block type
+  int flags;         // setpoint_flag_t mask
+  data_t t_blk;      // time since the block start (s)
+  data_t lambda;     // block fraction (0 to 1)
+  data_t feedrate;   // feedrate (mm/min)
+  data_t length;     // block length (mm)
+  data_t x, y, z;    // position (mm)
+} setpoint_t;
+
+
+/*
+  _____                 _   _
+ |  ___|   _ _ __   ___| |_(_) ___  _ __  ___
+ | |_ | | | | '_ \ / __| __| |/ _ \| '_ \/ __|
+ |  _|| |_| | | | | (__| |_| | (_) | | | \__ \
+ |_|   \__,_|_| |_|\___|\__|_|\___/|_| |_|___/
+
+*/
+
+/* LIFECYCLE ******************************************************************/
+// Queues up to the [C-CNC]:queue setpoints of program p
+trajectory_t *trajectory_new(program_t *p, machine_t const *m);
+// Stops the producer thread, if running
+void trajectory_free(trajectory_t *t);
+
+
+/* ACCESSORS ******************************************************************/
+// Times trajectory_pop() found the queue empty since the last start
+size_t trajectory_underruns(trajectory_t const *t);
+// Number of setpoints computed ahead of the one being executed
+size_t trajectory_length(trajectory_t const *t);
+// Whether the queue has been filled since the last start (or holds the
+// whole program): the motion should not begin before
+int trajectory_ready(trajectory_t const *t);
+
+
+/* METHODS ********************************************************************/
+// Resets the program and starts the producer thread, without waiting for
+// it to fill the queue (see trajectory_ready())
+ccnc_error_t trajectory_start(trajectory_t *t);
+// Stops the producer thread and empties the queue
+void trajectory_stop(trajectory_t *t);
+// Real-time side: copies the next setpoint into sp; returns 0, leaving sp
+// unchanged, when the producer is late
+int trajectory_pop(trajectory_t *t, setpoint_t *sp);
+// Real-time side: copies up to n of the next setpoints into sp, as long as
+// the motion goes on from prev (if not NULL) without stopping: across the
+// junctions of interpolated blocks (and the blocks without motion between
+// them), but not past the end of a rapid or of the program. Returns how
+// many, 0 when the producer is late or the motion stops after prev
+size_t trajectory_pop_block(trajectory_t *t, setpoint_t *sp, size_t n,
+                            setpoint_t const *prev);
+// Real-time side: the next setpoint, left in the queue, or NULL when the
+// producer is late (counted as an underrun, once ready); never waits
+setpoint_t const *trajectory_peek(trajectory_t *t);
+// Real-time side: as trajectory_peek(), without counting underruns
+setpoint_t const *trajectory_head(trajectory_t *t);
+// Offline consumers: the next setpoint, left in the queue. When the queue
+// is empty, waits for the producer
+setpoint_t const *trajectory_wait(trajectory_t *t);
+
+
+#endif // TRAJECTORY_H